@@ -1,28 +1,353 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+// Memory pressure generator. With just <megabytes> it allocates that much
+// and keeps touching every page, as before; the options shape the load:
+//
+//   -t N      sweep the working set with N threads (default 1)
+//   -w MB     working set: the first MB of the allocation are swept over
+//             and over; the rest is touched once and left cold, to be
+//             reclaimed or swapped (default: all of it)
+//   -c        keep the cold part resident too, refaulting what the kernel
+//             takes (default: leave it gone)
+//   -r SEC    ramp the RSS target from 0 to <megabytes> over SEC seconds
+//   -p 4k|thp back the allocation with 4 KiB pages or transparent huge
+//             pages (default: whatever the system does)
+//   -o read|write   how sweeps touch the working set (default write)
+//   -s BYTES  distance between touches (default 4096, one per page; 64
+//             touches every cache line)
+//   -b MB/s   touch bandwidth target, over all threads (default: no limit):
+//             each touch moves one cache line, so with the default stride
+//             -b 64 is a million touches a second
+//   -d SEC    stop after SEC seconds and print a summary (default: run
+//             until interrupted, which also prints it)
+//   -i SEC    report interval (default 1, 0 for none)
+//
+// RSS is held to its target by a control loop in the main thread: every
+// CONTROL_MS it compares the buffer's share of RSS with the target, faults
+// in more pages (or working-set pages the kernel took away) when short,
+// and gives pages back with MADV_DONTNEED when over. Under reclaim the
+// working-set split wins over the RSS target: cold pages the kernel takes
+// stay gone and RSS settles below target, unless -c makes the target win.
+//
+// Bandwidth is counted in cache lines touched, not in address range
+// swept: a stride of 4096 covers 64 times more address range than it
+// moves. Each sweeper paces itself against the bandwidth target by total
+// bytes touched so far, so it catches up after being descheduled. Fault
+// counts come from getrusage.
+
+#define CONTROL_MS 100
+#define CHUNK (256 * 1024)   // bytes swept between pacing checks
+#define HUGE_PAGE (2UL << 20)
+#define CACHE_LINE 64
+
+typedef enum { PAGES_DEFAULT, PAGES_4K, PAGES_THP } page_mode_t;
+
+typedef struct {
+    int id;
+    size_t lo, hi;              // working-set slice swept by this thread
+    unsigned long bytes;        // touched so far, in cache lines
+    unsigned long sum;          // read sweeps add up what they read
+} __attribute__((aligned(64))) sweeper_t;
+
+static struct {
+    char *mem;
+    size_t size;
+    size_t working_set;
+    size_t populated;           // bytes faulted in, from the start
+    size_t stride;
+    int write;
+    int refault_cold;           // refault reclaimed pages past the working set
+    double bandwidth;           // bytes/sec per thread, 0 = no limit
+    volatile sig_atomic_t stop;
+} load;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_sec(double s) {
+    struct timespec ts = { (time_t)s, (long)((s - (time_t)s) * 1e9) };
+    nanosleep(&ts, NULL);
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    load.stop = 1;
+}
+
+// Resident bytes of the whole process
+static size_t rss_bytes() {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(f);
+    }
+    return (size_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+void *sweeper(void *arg) {
+    sweeper_t *s = (sweeper_t *)arg;
+    // Pacing baseline, moved forward after idling so the sweeper doesn't
+    // burst to catch up on time it had nothing to sweep; s->bytes, which
+    // main reads, only ever grows
+    double start = now_sec();
+    unsigned long start_bytes = 0;
+    size_t pos = s->lo;
+    while (!load.stop) {
+        // Only the part already faulted in, while the RSS target ramps up
+        size_t hi = __atomic_load_n(&load.populated, __ATOMIC_ACQUIRE);
+        if (hi > s->hi)
+            hi = s->hi;
+        if (hi <= s->lo) {
+            sleep_sec(CONTROL_MS / 1000.0);
+            start = now_sec();
+            start_bytes = s->bytes;
+            continue;
+        }
+        if (pos >= hi)
+            pos = s->lo;
+        size_t end = pos + CHUNK < hi ? pos + CHUNK : hi;
+        if (load.write) {
+            for (size_t i = pos; i < end; i += load.stride)
+                load.mem[i] = (char)i;
+        } else {
+            unsigned long sum = 0;
+            for (size_t i = pos; i < end; i += load.stride)
+                sum += load.mem[i];
+            s->sum += sum;
+        }
+        // Touches below a cache line apart share lines
+        size_t touches = (end - pos + load.stride - 1) / load.stride;
+        size_t line = load.stride < CACHE_LINE ? load.stride : CACHE_LINE;
+        __atomic_store_n(&s->bytes, s->bytes + touches * line, __ATOMIC_RELAXED);
+        pos = end;
+
+        if (load.bandwidth > 0) {
+            double ahead = (s->bytes - start_bytes) / load.bandwidth - (now_sec() - start);
+            if (ahead > 0)
+                sleep_sec(ahead);
+        }
+    }
+    return NULL;
+}
+
+// Bring the buffer's resident size to target: fault in past the populated
+// end, then refault pages the kernel reclaimed (in the working set only,
+// without -c); or drop pages off the end when over. Returns the bytes it
+// touched or dropped.
+size_t control_rss(size_t target, size_t resident, size_t unit, unsigned char *vec) {
+    size_t done = 0;
+    target = target / unit * unit;
+    if (resident + unit <= target) {
+        size_t want = target - resident;
+        size_t end = target < load.size ? target : load.size;
+        if (load.populated < end) {
+            size_t grow = end - load.populated;
+            if (grow > want)
+                grow = (want + unit - 1) / unit * unit;
+            for (size_t i = load.populated; i < load.populated + grow; i += 4096)
+                load.mem[i] = 1;
+            __atomic_store_n(&load.populated, load.populated + grow, __ATOMIC_RELEASE);
+            done += grow;
+            want = done < want ? want - done : 0;
+        }
+        // Still short: pages below the end were reclaimed or swapped out
+        size_t hot = load.populated;
+        if (!load.refault_cold && hot > load.working_set)
+            hot = load.working_set;
+        if (want > 0 && hot > 0 && vec != NULL && mincore(load.mem, hot, vec) == 0) {
+            size_t page = sysconf(_SC_PAGESIZE);
+            for (size_t p = 0; p < hot / page && want > 0; p++) {
+                if (vec[p] & 1)
+                    continue;
+                load.mem[p * page] = 1;
+                done += page;
+                want = want > page ? want - page : 0;
+            }
+        }
+    } else if (resident >= target + unit && load.populated > target) {
+        // Over: give back the end, down to the target
+        size_t drop = load.populated - target;
+        if (drop > resident - target)
+            drop = (resident - target) / unit * unit;
+        if (drop > 0) {
+            __atomic_store_n(&load.populated, load.populated - drop, __ATOMIC_RELEASE);
+            madvise(load.mem + load.populated, drop, MADV_DONTNEED);
+            done += drop;
+        }
+    }
+    return done;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-t threads] [-w working_set_mb] [-c] [-r ramp_sec] [-p 4k|thp] "
+            "[-o read|write]\n"
+            "          [-s stride] [-b mb_per_sec] [-d sec] [-i report_sec] <megabytes>\n", prog);
+}
 
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("Usage: %s <megabytes>\n", argv[0]);
+    int threads = 1;
+    double working_mb = -1, ramp = 0, duration = 0, interval = 1, bandwidth_mb = 0;
+    page_mode_t pages = PAGES_DEFAULT;
+    load.stride = 4096;
+    load.write = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:w:cr:p:o:s:b:d:i:")) != -1) {
+        switch (opt) {
+        case 't': threads = atoi(optarg); break;
+        case 'w': working_mb = atof(optarg); break;
+        case 'c': load.refault_cold = 1; break;
+        case 'r': ramp = atof(optarg); break;
+        case 's': load.stride = strtoul(optarg, NULL, 0); break;
+        case 'b': bandwidth_mb = atof(optarg); break;
+        case 'd': duration = atof(optarg); break;
+        case 'i': interval = atof(optarg); break;
+        case 'p':
+            if (strcmp(optarg, "4k") == 0)
+                pages = PAGES_4K;
+            else if (strcmp(optarg, "thp") == 0)
+                pages = PAGES_THP;
+            else
+                threads = 0;
+            break;
+        case 'o':
+            if (strcmp(optarg, "read") == 0)
+                load.write = 0;
+            else if (strcmp(optarg, "write") != 0)
+                threads = 0;
+            break;
+        default:
+            threads = 0;
+        }
+    }
+    if (argc - optind != 1 || threads <= 0 || load.stride == 0) {
+        usage(argv[0]);
         return 1;
     }
 
-    int mb = atoi(argv[1]);
+    int mb = atoi(argv[optind]);
     size_t size = (size_t)mb * 1024 * 1024;
-    char *mem = malloc(size);
-    if (!mem) {
+    size_t unit = (pages == PAGES_THP) ? HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE);
+    if (size == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    load.size = (size + unit - 1) / unit * unit;
+    load.working_set = (working_mb < 0) ? load.size : (size_t)(working_mb * 1024 * 1024);
+    if (load.working_set > load.size)
+        load.working_set = load.size;
+    load.bandwidth = bandwidth_mb * 1024 * 1024 / threads;
+
+    // mmap rather than malloc, so THP can be asked for on an aligned range
+    char *mem = mmap(NULL, load.size + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
         printf("Memory allocation failed\n");
         return 1;
     }
+    load.mem = (char *)(((unsigned long)mem + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1));
+    if (pages != PAGES_DEFAULT &&
+        madvise(load.mem, load.size, pages == PAGES_THP ? MADV_HUGEPAGE : MADV_NOHUGEPAGE) != 0)
+        perror("madvise");
+
+    // mincore's vector, for finding reclaimed pages; without it the
+    // controller can only grow
+    unsigned char *vec = malloc(load.size / sysconf(_SC_PAGESIZE) + 1);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
 
     printf("Allocated %d MB. Using it continuously...\n", mb);
-    while (1) {
-        for (size_t i = 0; i < size; i += 4096)
-            mem[i] = 0;  // touch each page
-        usleep(10000);  // small pause
+    printf("%d threads, working set %zu MB, %s pages, %s sweeps every %zu bytes, ",
+           threads, load.working_set >> 20,
+           pages == PAGES_THP ? "THP" : (pages == PAGES_4K ? "4 KiB" : "default"),
+           load.write ? "write" : "read", load.stride);
+    if (bandwidth_mb > 0)
+        printf("%.1f MB/s touch target\n", bandwidth_mb);
+    else
+        printf("no bandwidth limit\n");
+    fflush(stdout);
+
+    size_t base_rss = rss_bytes();
+    sweeper_t *sweepers = aligned_alloc(64, threads * sizeof(sweeper_t));
+    pthread_t p[threads];
+    for (int i = 0; i < threads; i++) {
+        memset(&sweepers[i], 0, sizeof(sweepers[i]));
+        sweepers[i].id = i;
+        sweepers[i].lo = load.working_set / threads * i / load.stride * load.stride;
+        sweepers[i].hi = (i == threads - 1) ? load.working_set
+                         : load.working_set / threads * (i + 1) / load.stride * load.stride;
+        pthread_create(&p[i], NULL, sweeper, &sweepers[i]);
+    }
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    long minflt0 = ru.ru_minflt, majflt0 = ru.ru_majflt;
+    long last_minflt = minflt0, last_majflt = majflt0;
+    double start = now_sec(), last_report = start;
+    unsigned long last_bytes = 0, total_bytes = 0;
+    size_t target = 0, resident = 0;
+    while (!load.stop) {
+        double elapsed = now_sec() - start;
+        if (duration > 0 && elapsed >= duration)
+            break;
+        target = (ramp > 0 && elapsed < ramp) ? (size_t)(load.size * (elapsed / ramp)) : load.size;
+        size_t rss = rss_bytes();
+        resident = rss > base_rss ? rss - base_rss : 0;
+        control_rss(target, resident, unit, vec);
+
+        total_bytes = 0;
+        for (int i = 0; i < threads; i++)
+            total_bytes += __atomic_load_n(&sweepers[i].bytes, __ATOMIC_RELAXED);
+        double t = now_sec();
+        if (interval > 0 && t - last_report >= interval) {
+            getrusage(RUSAGE_SELF, &ru);
+            printf("%7.1f s: RSS %zu MB (target %zu MB), %.1f MB/s touched, "
+                   "%ld minor + %ld major faults\n", t - start, resident >> 20, target >> 20,
+                   (total_bytes - last_bytes) / (t - last_report) / (1024 * 1024),
+                   ru.ru_minflt - last_minflt, ru.ru_majflt - last_majflt);
+            fflush(stdout);
+            last_minflt = ru.ru_minflt;
+            last_majflt = ru.ru_majflt;
+            last_bytes = total_bytes;
+            last_report = t;
+        }
+        sleep_sec(CONTROL_MS / 1000.0);
+    }
+
+    load.stop = 1;
+    unsigned long sum = 0;
+    total_bytes = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(p[i], NULL);
+        total_bytes += __atomic_load_n(&sweepers[i].bytes, __ATOMIC_RELAXED);
+        sum += sweepers[i].sum;
     }
+    double elapsed = now_sec() - start;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("total: %.1f s, %.2f GB touched, %.1f MB/s, RSS %zu MB (target %zu MB), "
+           "%ld minor + %ld major faults\n", elapsed,
+           total_bytes / (1024.0 * 1024 * 1024), total_bytes / elapsed / (1024 * 1024),
+           resident >> 20, target >> 20,
+           ru.ru_minflt - minflt0, ru.ru_majflt - majflt0);
+    if (sum == 1)   // keep the read sweeps
+        printf("sum=%lu\n", sum);
 
-    free(mem);
+    free(sweepers);
+    free(vec);
+    munmap(mem, load.size + HUGE_PAGE);
     return 0;
-}
\ No newline at end of file
+}
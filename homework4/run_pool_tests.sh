@@ -0,0 +1,60 @@
+#!/bin/bash
+
+# Regression tests for pool_malloc.so: each homework4 bug program runs
+# under POOL_DEBUG=1 and must be caught, and vector-bench (which is
+# correct) must run without any report but a clean leak summary.
+
+cd "$(dirname "$0")" || exit 1
+BUILD=$(mktemp -d)
+trap 'rm -rf "$BUILD"' EXIT
+
+echo "Compiling pool_malloc.so and the test programs..."
+gcc -O2 -Wall -shared -fPIC -pthread -o "$BUILD/pool_malloc.so" pool_malloc.c || exit 1
+# The bug programs are wrong on purpose; gcc warns about two of them
+for PROG in memory_leak free_middle print_after_free end_zero; do
+    gcc -w -o "$BUILD/$PROG" $PROG.c || exit 1
+done
+gcc -Wall -o "$BUILD/vector-bench" vector-bench.c || exit 1
+
+FAILED=0
+
+# expect <program> <pattern> [args...]: run under POOL_DEBUG=1, pass if
+# the combined output matches the extended regex pattern
+expect() {
+    local PROG=$1 PATTERN=$2
+    shift 2
+    local OUT
+    OUT=$(POOL_DEBUG=1 LD_PRELOAD="$BUILD/pool_malloc.so" "$BUILD/$PROG" "$@" 2>&1)
+    if grep -Eq "$PATTERN" <<< "$OUT"; then
+        echo "PASS  $PROG: $(grep -E -m1 "$PATTERN" <<< "$OUT")"
+    else
+        echo "FAIL  $PROG: expected /$PATTERN/, got:"
+        sed 's/^/      /' <<< "$OUT"
+        FAILED=1
+    fi
+}
+
+expect memory_leak      'leak: 400 bytes at'
+expect free_middle      'free\(0x[0-9a-f]+\): interior pointer, 200 bytes into'
+expect print_after_free  'Value at data\[50\]: -555819298'    # 0xdededede
+expect end_zero         'heap overflow: write past the end of 0x[0-9a-f]+ \(400 bytes'
+expect vector-bench     'pool_malloc: 0 leaks, 0 bytes' 1e6
+
+# No false alarms: the correct program must not trigger any other report
+OUT=$(POOL_DEBUG=1 LD_PRELOAD="$BUILD/pool_malloc.so" "$BUILD/vector-bench" 1e6 2>&1)
+if grep -E 'pool_malloc: (leak|heap|double|write|free|realloc)' <<< "$OUT"; then
+    echo "FAIL  vector-bench: unexpected report"
+    FAILED=1
+fi
+
+# Without POOL_DEBUG only bad frees are reported; everything else runs
+# as under glibc
+for PROG in memory_leak print_after_free end_zero; do
+    if ! LD_PRELOAD="$BUILD/pool_malloc.so" "$BUILD/$PROG" > /dev/null 2>&1; then
+        echo "FAIL  $PROG: exits nonzero without POOL_DEBUG"
+        FAILED=1
+    fi
+done
+
+[ $FAILED -eq 0 ] && echo "All pool_malloc tests passed"
+exit $FAILED
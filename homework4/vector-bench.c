@@ -0,0 +1,158 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "vector.h"
+
+// Builds a vector of <num_ints> ints with each growth strategy:
+//
+//   2x        push one at a time, doubling (vector_init's policy)
+//   1.5x      push one at a time, growing by 1.5
+//   reserve   vector_reserve(num_ints) first, then push: one allocation
+//   append    vector_append in chunks of APPEND_CHUNK, growing by 1.5
+//   mremap    push, doubling, switching to mremap at VECTOR_MAP_THRESHOLD
+//
+// Each strategy runs in its own child process, so the peak RSS it reports
+// (getrusage ru_maxrss) is its own. A grow that copies holds the old and
+// the new block at once, but under glibc realloc remaps blocks past its
+// mmap threshold, so every strategy peaks near the final size (1e8 ints:
+// 382 MiB each) and bytes copied stays under 1 MiB.
+
+#define APPEND_CHUNK 4096
+
+typedef enum {
+    STRATEGY_2X,
+    STRATEGY_1_5X,
+    STRATEGY_RESERVE,
+    STRATEGY_APPEND,
+    STRATEGY_MREMAP,
+    NUM_STRATEGIES,
+} strategy_t;
+
+static const char *strategy_names[] = {
+    [STRATEGY_2X]      = "2x",
+    [STRATEGY_1_5X]    = "1.5x",
+    [STRATEGY_RESERVE] = "reserve",
+    [STRATEGY_APPEND]  = "append",
+    [STRATEGY_MREMAP]  = "mremap",
+};
+
+static inline long get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void build(strategy_t s, Vector *v, size_t n) {
+    switch (s) {
+    case STRATEGY_2X:
+        vector_init(v);
+        for (size_t i = 0; i < n; i++)
+            vector_push(v, (int)i);
+        break;
+    case STRATEGY_1_5X:
+        vector_init_policy(v, 1.5, 0);
+        for (size_t i = 0; i < n; i++)
+            vector_push(v, (int)i);
+        break;
+    case STRATEGY_RESERVE:
+        vector_init(v);
+        vector_reserve(v, n);
+        for (size_t i = 0; i < n; i++)
+            vector_push(v, (int)i);
+        break;
+    case STRATEGY_APPEND: {
+        int chunk[APPEND_CHUNK];
+        vector_init_policy(v, 1.5, 0);
+        for (size_t i = 0; i < n; i += APPEND_CHUNK) {
+            size_t len = (n - i < APPEND_CHUNK) ? n - i : APPEND_CHUNK;
+            for (size_t j = 0; j < len; j++)
+                chunk[j] = (int)(i + j);
+            vector_append(v, chunk, len);
+        }
+        break;
+    }
+    default:
+        vector_init_policy(v, 2.0, VECTOR_MAP_THRESHOLD);
+        for (size_t i = 0; i < n; i++)
+            vector_push(v, (int)i);
+        break;
+    }
+}
+
+// Child process: build, check and report one strategy
+int run(strategy_t s, size_t n) {
+    Vector v;
+    long start = get_time_ns();
+    build(s, &v, n);
+    double elapsed = (get_time_ns() - start) / 1e9;
+
+    int ok = (v.size == n);
+    for (size_t i = 0; ok && i < n; i++)
+        ok = (v.data[i] == (int)i);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%-8s %zu ints: %.3f sec, %.2f ns per int, peak RSS %.1f MiB, "
+           "%.1f MiB copied in %zu grows (%.2f bytes per int)\n",
+           strategy_names[s], n, elapsed, elapsed * 1e9 / n, ru.ru_maxrss / 1024.0,
+           v.bytes_copied / (1024.0 * 1024.0), v.grows, (double)v.bytes_copied / n);
+    if (!ok)
+        printf("BROKEN: %s vector contents are wrong\n", strategy_names[s]);
+    vector_free(&v);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <num_ints> [2x|1.5x|reserve|append|mremap ...]\n", argv[0]);
+        return 1;
+    }
+    // Accept 1e9 as well as 1000000000
+    size_t n = (size_t)strtod(argv[1], NULL);
+    if (n == 0) {
+        fprintf(stderr, "num_ints must be positive\n");
+        return 1;
+    }
+
+    int run_it[NUM_STRATEGIES];
+    for (int s = 0; s < NUM_STRATEGIES; s++)
+        run_it[s] = (argc == 2);
+    for (int i = 2; i < argc; i++) {
+        int s;
+        for (s = 0; s < NUM_STRATEGIES; s++)
+            if (strcmp(argv[i], strategy_names[s]) == 0)
+                break;
+        if (s == NUM_STRATEGIES) {
+            fprintf(stderr, "unknown strategy %s\n", argv[i]);
+            return 1;
+        }
+        run_it[s] = 1;
+    }
+
+    int failed = 0;
+    for (int s = 0; s < NUM_STRATEGIES; s++) {
+        if (!run_it[s])
+            continue;
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0)
+            exit(run(s, n));
+        int status;
+        waitpid(pid, &status, 0);
+        if (WIFSIGNALED(status))
+            printf("%-8s %zu ints: killed by signal %d (out of memory?)\n",
+                   strategy_names[s], n, WTERMSIG(status));
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed = 1;
+    }
+    return failed;
+}
@@ -0,0 +1,164 @@
+#ifndef __vector_h__
+#define __vector_h__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Growable array of ints.
+//
+// When full, the capacity is multiplied by the growth factor and the
+// block is grown with realloc, as vector.c always did. realloc doesn't say
+// whether it copied: bytes_copied counts the old block when the pointer
+// moved, unless both blocks are glibc mmap chunks (at least 128 KiB, the
+// minimum mmap threshold), which realloc moves with mremap instead of
+// copying. With a factor of 2 each new block is bigger than all the freed
+// ones put together, so malloc can never reuse them; with 1.5 the freed
+// blocks add up to enough after a few steps. That only helps a vector
+// sharing the heap below the mmap threshold: alone at the top of the heap
+// it grows in place (vector-bench 2e4 copies nothing with either factor),
+// and above the threshold freed blocks go back to the kernel and realloc
+// remaps, so either factor copies only when it crosses the threshold.
+//
+// Once the capacity reaches map_threshold bytes (0 = never), the elements
+// move once into an mmap'd region that then grows with mremap, which
+// remaps the pages instead of copying them: a large vector is not copied
+// again however far it grows. Needs _GNU_SOURCE for mremap.
+
+#define VECTOR_MAP_THRESHOLD (1 << 20)
+
+typedef struct {
+    int *data;      // pointer to array of elements
+    size_t size;    // current number of elements
+    size_t capacity;// total allocated space
+    double growth;          // capacity multiplier when full
+    size_t map_threshold;   // bytes at which to switch to mremap, 0 = never
+    int mapped;             // data is an mmap'd region of capacity ints
+    size_t bytes_copied;    // by growing, over the vector's life
+    size_t grows;
+} Vector;
+
+// Initialize vector with the given growth factor (> 1) and mremap
+// threshold
+static inline void vector_init_policy(Vector *v, double growth, size_t map_threshold) {
+    if (growth <= 1) {
+        fprintf(stderr, "vector growth factor must be above 1\n");
+        exit(1);
+    }
+    v->size = 0;
+    v->capacity = 2;  // start small
+    v->growth = growth;
+    v->map_threshold = map_threshold;
+    v->mapped = 0;
+    v->bytes_copied = 0;
+    v->grows = 0;
+    v->data = malloc(v->capacity * sizeof(int));
+    if (!v->data) {
+        perror("malloc");
+        exit(1);
+    }
+}
+
+// Initialize vector: doubles, always on the heap
+static inline void vector_init(Vector *v) {
+    vector_init_policy(v, 2.0, 0);
+}
+
+// glibc marks a chunk served by its own mmap with bit 1 of the size word
+// just before the block; other allocators leave garbage there, making
+// bytes_copied approximate
+static inline int vector_heap_mapped(const int *p) {
+    return (*(const size_t *)((uintptr_t)p - sizeof(size_t)) & 2) != 0;
+}
+
+static inline size_t vector_page_round(size_t bytes) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (bytes + page - 1) / page * page;
+}
+
+// Move the elements to storage for exactly capacity ints (rounded up to
+// whole pages once mapped)
+static inline void vector_set_capacity(Vector *v, size_t capacity) {
+    size_t bytes = capacity * sizeof(int);
+    int *new_data;
+    if (v->mapped) {
+        bytes = vector_page_round(bytes);
+        new_data = mremap(v->data, v->capacity * sizeof(int), bytes, MREMAP_MAYMOVE);
+        if (new_data == MAP_FAILED) {
+            perror("mremap");
+            exit(1);
+        }
+    } else if (v->map_threshold > 0 && bytes >= v->map_threshold) {
+        bytes = vector_page_round(bytes);
+        new_data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (new_data == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+        memcpy(new_data, v->data, v->size * sizeof(int));
+        v->bytes_copied += v->size * sizeof(int);
+        free(v->data);
+        v->mapped = 1;
+    } else {
+        uintptr_t old = (uintptr_t)v->data;
+        int old_mapped = vector_heap_mapped(v->data);
+        new_data = realloc(v->data, bytes);
+        if (!new_data) {
+            perror("realloc");
+            free(v->data);
+            exit(1);
+        }
+        if ((uintptr_t)new_data != old && !(old_mapped && vector_heap_mapped(new_data)))
+            v->bytes_copied += v->capacity * sizeof(int);
+    }
+    v->data = new_data;
+    v->capacity = bytes / sizeof(int);
+    v->grows++;
+}
+
+// Grow by the growth factor until at least min_capacity ints fit
+static inline void vector_grow(Vector *v, size_t min_capacity) {
+    size_t capacity = v->capacity;
+    while (capacity < min_capacity) {
+        size_t next = (size_t)(capacity * v->growth);
+        capacity = next > capacity ? next : capacity + 1;
+    }
+    vector_set_capacity(v, capacity);
+}
+
+// Make room for n elements in total, with no growth factor on top
+static inline void vector_reserve(Vector *v, size_t n) {
+    if (n > v->capacity)
+        vector_set_capacity(v, n);
+}
+
+// Add element, grow array if needed
+static inline void vector_push(Vector *v, int value) {
+    if (v->size == v->capacity)
+        vector_grow(v, v->size + 1);
+    v->data[v->size++] = value;
+}
+
+// Add n elements at once, growing at most once
+static inline void vector_append(Vector *v, const int *values, size_t n) {
+    if (v->size + n > v->capacity)
+        vector_grow(v, v->size + n);
+    memcpy(v->data + v->size, values, n * sizeof(int));
+    v->size += n;
+}
+
+// Free memory
+static inline void vector_free(Vector *v) {
+    if (v->mapped)
+        munmap(v->data, v->capacity * sizeof(int));
+    else
+        free(v->data);
+    v->data = NULL;
+    v->size = v->capacity = 0;
+    v->mapped = 0;
+}
+
+#endif // __vector_h__
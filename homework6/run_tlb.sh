@@ -1,15 +1,15 @@
 #!/bin/bash
 
-TRIALS=100000      # large enough for stable timing
-MAXPAGES=4096        # test up to 4096 pages
-CPU=0                # pin process to CPU 0
-
-# Recompile with -O0 and volatile to prevent optimization 
-echo "Compiling tlb.c with optimization disabled..."
-gcc -O0 -Wall -std=c11 -o tlb tlb.c
-
-echo "Pages, ns_per_access"
-
-for ((P=1; P<=MAXPAGES; P*=2)); do
-    ./tlb $P $TRIALS | awk '{print $1 "," $3}'
-done
\ No newline at end of file
+# Sweep tlb over page counts and infer the L1 dTLB, L2 STLB and cache
+# sizes. tlb_characterize.py builds tlb with -O2, refines page counts
+# around each latency step, scales trials to a target time per run and
+# repeats each point; progress goes to stderr and the result to stdout
+# as JSON. Options pass through (see ./tlb_characterize.py --help), e.g.
+#
+#   ./run_tlb.sh --modes page,thp,hugetlb -o tlb.json
+#
+# hugetlb needs vm.nr_hugepages >= --max-huge-pages. dTLB misses per
+# access come from perf_event_open; null where the CPU or
+# /proc/sys/kernel/perf_event_paranoid does not allow counting them.
+
+exec python3 "$(dirname "$0")/tlb_characterize.py" "$@"
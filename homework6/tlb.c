@@ -1,20 +1,498 @@
 #define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
 #include <sched.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <linux/perf_event.h>
 
-#define PAGESIZE 4096
+#define CACHE_LINE 64
+#define DEFAULT_HUGE_PAGE (2UL << 20)
+#define DEFAULT_TARGET_MS 100
+#define MAX_NODES 1024
+
+// Compiler barrier: the compiler must assume the asm reads x and all of
+// memory, so it can neither drop the accesses before it nor merge them
+// across iterations. It emits no instructions.
+#define OPAQUE(x) __asm__ __volatile__("" : : "r"(x) : "memory")
+
+// How the array is backed
+typedef enum {
+    MODE_PAGE,       // regular pages
+    MODE_HUGETLB,    // MAP_HUGETLB from the reserved pool (vm.nr_hugepages)
+    MODE_THP,        // transparent huge pages via madvise(MADV_HUGEPAGE)
+} alloc_mode_t;
+
+static const char *mode_names[] = {
+    [MODE_PAGE]    = "page",
+    [MODE_HUGETLB] = "hugetlb",
+    [MODE_THP]     = "thp",
+};
+
+// Order in which the pages are visited
+typedef enum {
+    ORDER_SEQ,       // 0, 1, 2, ...: the prefetcher can run ahead
+    ORDER_RAND,      // fixed random permutation; addresses are still
+                     // known up front, so misses can overlap
+    ORDER_CHASE,     // each page holds a pointer to the next in a random
+                     // cycle: one dependent miss at a time
+} access_order_t;
+
+static const char *order_names[] = {
+    [ORDER_SEQ]   = "seq",
+    [ORDER_RAND]  = "rand",
+    [ORDER_CHASE] = "chase",
+};
+
+// How the churn thread changes mappings in shootdown mode (-t). Either way
+// the kernel has to flush the old translation from every CPU running this
+// process, which interrupts the walkers.
+typedef enum {
+    CHURN_MPROTECT,  // flip a page between read-write and read-only
+    CHURN_MUNMAP,    // map, touch and unmap a page
+} churn_kind_t;
+
+static const char *churn_names[] = {
+    [CHURN_MPROTECT] = "mprotect",
+    [CHURN_MUNMAP]   = "munmap",
+};
+
+// Open a disabled, user-only dTLB miss counter for this thread (op is
+// PERF_COUNT_HW_CACHE_OP_READ or _WRITE). Returns -1 if the CPU or the
+// perf_event_paranoid setting does not allow it.
+int open_dtlb_counter(int op) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (op << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+int parse_name(const char *s, const char **names, int n) {
+    for (int i = 0; i < n; i++)
+        if (strcmp(s, names[i]) == 0)
+            return i;
+    return -1;
+}
+
+// PMD-sized (huge) page size, as the kernel reports it
+size_t huge_page_size(void) {
+    size_t size = 0;
+    FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%zu", &size) != 1)
+            size = 0;
+        fclose(f);
+    }
+    return size ? size : DEFAULT_HUGE_PAGE;
+}
+
+// Map bytes (a multiple of pagesize) backed as mode asks, aligned to
+// pagesize. Returns NULL with a message on failure.
+char *alloc_pages(alloc_mode_t mode, size_t bytes, size_t pagesize) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    char *p;
+    switch (mode) {
+    case MODE_HUGETLB:
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) {
+            perror("mmap(MAP_HUGETLB)");
+            fprintf(stderr, "need %zu huge pages reserved: sysctl vm.nr_hugepages=%zu\n",
+                    bytes / pagesize, bytes / pagesize);
+            return NULL;
+        }
+        return p;
+    case MODE_THP:
+        // Over-map so a pagesize-aligned range fits, and trim the ends
+        p = mmap(NULL, bytes + pagesize, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (p == MAP_FAILED) {
+            perror("mmap");
+            return NULL;
+        }
+        char *aligned = (char *)(((uintptr_t)p + pagesize - 1) & ~(pagesize - 1));
+        if (aligned > p)
+            munmap(p, aligned - p);
+        if (aligned + bytes < p + bytes + pagesize)
+            munmap(aligned + bytes, p + bytes + pagesize - (aligned + bytes));
+        if (madvise(aligned, bytes, MADV_HUGEPAGE) != 0)
+            perror("madvise(MADV_HUGEPAGE)");
+        return aligned;
+    default:
+        p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (p == MAP_FAILED) {
+            perror("mmap");
+            return NULL;
+        }
+        return p;
+    }
+}
+
+// kB of the mapping at addr that is backed by transparent huge pages
+long thp_backed_kb(void *addr) {
+    FILE *f = fopen("/proc/self/smaps", "r");
+    if (f == NULL)
+        return -1;
+    char line[256];
+    int in_range = 0;
+    long kb = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long lo, hi;
+        if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2) {
+            in_range = (uintptr_t)addr >= lo && (uintptr_t)addr < hi;
+        } else if (in_range && sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+// Fixed-seed Fisher-Yates shuffle, so runs are comparable
+void shuffle(int *order, int n) {
+    unsigned long x = 88172645463325252UL;
+    for (int i = n - 1; i > 0; i--) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        int j = x % (i + 1);
+        int tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+}
+
+// NUMA placement goes through the raw syscalls, so this builds without
+// libnuma. maxnode is one more than the mask's bits; the kernel drops one.
+void node_mask(unsigned long *mask, int node) {
+    memset(mask, 0, MAX_NODES / 8);
+    mask[node / (8 * sizeof(long))] |= 1UL << (node % (8 * sizeof(long)));
+}
+
+// Bind the data pages of [addr, addr + len) to node
+int bind_to_node(void *addr, size_t len, int node) {
+    unsigned long mask[MAX_NODES / (8 * sizeof(long))];
+    node_mask(mask, node);
+    return syscall(SYS_mbind, addr, len, MPOL_BIND, mask, MAX_NODES + 1, MPOL_MF_STRICT);
+}
+
+// Bind this thread's future allocations, page tables included, to node;
+// node < 0 restores the default policy
+int set_node_policy(int node) {
+    unsigned long mask[MAX_NODES / (8 * sizeof(long))];
+    if (node < 0)
+        return syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+    node_mask(mask, node);
+    return syscall(SYS_set_mempolicy, MPOL_BIND, mask, MAX_NODES + 1);
+}
+
+// Node the page at addr is on, or -errno
+int page_node(void *addr) {
+    int status = -EFAULT;
+    if (syscall(SYS_move_pages, 0, 1, &addr, NULL, &status, 0) != 0)
+        return -errno;
+    return status;
+}
+
+// Node of the CPU this thread runs on
+int current_node(void) {
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+        return -1;
+    return node;
+}
+
+// Sum of the TLB shootdown IPIs over all CPUs, or -1 where
+// /proc/interrupts has no TLB line (it is x86 only)
+long tlb_shootdowns(void) {
+    FILE *f = fopen("/proc/interrupts", "r");
+    if (f == NULL)
+        return -1;
+    char line[4096];
+    long total = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *p = line;
+        while (*p == ' ')
+            p++;
+        if (strncmp(p, "TLB:", 4) != 0)
+            continue;
+        p += 4;
+        total = 0;
+        for (;;) {
+            char *end;
+            long n = strtol(p, &end, 10);
+            if (end == p)
+                break;
+            total += n;
+            p = end;
+        }
+        break;
+    }
+    fclose(f);
+    return total;
+}
+
+static inline long get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Make trials passes over the slots; returns elapsed ns
+long walk(int **slots, int num_slots, access_order_t order, long long trials) {
+    long start = get_time_ns();
+    if (order == ORDER_CHASE) {
+        void *p = slots[0];
+        for (long long t = 0; t < trials; t++)
+            for (int i = 0; i < num_slots; i++)
+                p = *(void **)p;
+        OPAQUE(p);
+    } else {
+        for (long long t = 0; t < trials; t++) {
+            for (int i = 0; i < num_slots; i++) {
+                *slots[i] += 1;
+                OPAQUE(slots[i]);
+            }
+        }
+    }
+    return get_time_ns() - start;
+}
+
+// Trial count for a run of about target_ns: double it until a run takes a
+// tenth of the target, then scale up. This also warms the caches and TLB.
+long long calibrate_trials(int **slots, int num_slots, access_order_t order, long target_ns) {
+    long long trials = 1;
+    for (;;) {
+        long ns = walk(slots, num_slots, order, trials);
+        if (ns >= target_ns / 10) {
+            long long scaled = (long long)((double)trials * target_ns / ns);
+            return scaled > 0 ? scaled : 1;
+        }
+        trials *= 2;
+    }
+}
+
+void pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        fprintf(stderr, "warning: could not pin to CPU %d\n", cpu);
+}
+
+// Walker threads chase through the shared slots on CPUs 1, 2, ... while
+// a churn thread on CPU 0 changes mappings in the same process. Each run
+// is timed twice, without and with the churn thread; the difference is
+// what the shootdowns cost the walkers.
+typedef struct {
+    int cpu;
+    long elapsed_ns;
+    long max_pass_ns;
+} __attribute__((aligned(64))) walker_t;
+
+typedef struct {
+    int **slots;
+    int num_slots;
+    access_order_t order;
+    long long trials;
+    churn_kind_t churn;
+    int stop;
+    long changes;
+    pthread_barrier_t start;
+} shootdown_t;
+
+static shootdown_t sd;
+
+void *walker_thread(void *arg) {
+    walker_t *w = (walker_t *)arg;
+    pin_to_cpu(w->cpu);
+    w->max_pass_ns = 0;
+    pthread_barrier_wait(&sd.start);
+    long start = get_time_ns();
+    for (long long t = 0; t < sd.trials; t++) {
+        long ns = walk(sd.slots, sd.num_slots, sd.order, 1);
+        if (ns > w->max_pass_ns)
+            w->max_pass_ns = ns;
+    }
+    w->elapsed_ns = get_time_ns() - start;
+    return NULL;
+}
+
+void *churn_thread(void *arg) {
+    (void)arg;
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    int prot = PROT_READ | PROT_WRITE;
+    pin_to_cpu(0);
+    // The page must be present, or there is no translation to flush
+    char *page = mmap(NULL, pagesize, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED)
+        perror("mmap: churn page, no churn this run");
+    else
+        page[0] = 1;
+    // Walkers wait at the barrier for us either way
+    pthread_barrier_wait(&sd.start);
+    long changes = 0;
+    while (page != MAP_FAILED && !__atomic_load_n(&sd.stop, __ATOMIC_RELAXED)) {
+        if (sd.churn == CHURN_MPROTECT) {
+            mprotect(page, pagesize, PROT_READ);
+            mprotect(page, pagesize, prot);
+        } else {
+            munmap(page, pagesize);
+            page = mmap(NULL, pagesize, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (page == MAP_FAILED) {
+                perror("mmap: churn page, stopping churn");
+                break;
+            }
+            page[0] = 1;
+        }
+        changes++;
+    }
+    if (page != MAP_FAILED)
+        munmap(page, pagesize);
+    sd.changes = changes;
+    return NULL;
+}
+
+// One timed run of all walkers; returns their summed time
+long run_walkers(walker_t *walkers, int num_walkers, int churn, long *max_pass_ns) {
+    pthread_t p[num_walkers], c;
+    pthread_barrier_init(&sd.start, NULL, num_walkers + churn);
+    sd.stop = 0;
+    sd.changes = 0;
+    if (churn)
+        pthread_create(&c, NULL, churn_thread, NULL);
+    for (int i = 0; i < num_walkers; i++)
+        pthread_create(&p[i], NULL, walker_thread, &walkers[i]);
+    for (int i = 0; i < num_walkers; i++)
+        pthread_join(p[i], NULL);
+    __atomic_store_n(&sd.stop, 1, __ATOMIC_RELAXED);
+    if (churn)
+        pthread_join(c, NULL);
+    pthread_barrier_destroy(&sd.start);
+
+    long total = 0;
+    *max_pass_ns = 0;
+    for (int i = 0; i < num_walkers; i++) {
+        total += walkers[i].elapsed_ns;
+        if (walkers[i].max_pass_ns > *max_pass_ns)
+            *max_pass_ns = walkers[i].max_pass_ns;
+    }
+    return total;
+}
+
+void shootdown(int **slots, int num_slots, access_order_t order, long long trials,
+               int num_walkers, churn_kind_t churn) {
+    int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpus < num_walkers + 1)
+        fprintf(stderr, "warning: %d CPUs for %d walkers and the churn thread; they share "
+                "CPUs, so walkers are also slowed by being descheduled\n", ncpus, num_walkers);
+    sd.slots = slots;
+    sd.num_slots = num_slots;
+    sd.order = order;
+    sd.trials = trials;
+    sd.churn = churn;
+    walker_t walkers[num_walkers];
+    for (int i = 0; i < num_walkers; i++)
+        walkers[i].cpu = (i + 1) % ncpus;
+
+    double accesses = (double)num_walkers * num_slots * trials;
+    long max_pass;
+    long base = run_walkers(walkers, num_walkers, 0, &max_pass);
+    printf("%d pages, %d walkers, no churn: %.2f ns per access, max pass %ld ns\n",
+           num_slots, num_walkers, base / accesses, max_pass);
+
+    long ipis = tlb_shootdowns();
+    long churned = run_walkers(walkers, num_walkers, 1, &max_pass);
+    if (ipis >= 0)
+        ipis = tlb_shootdowns() - ipis;
+    printf("%d pages, %d walkers, %s churn: %.2f ns per access, max pass %ld ns, "
+           "%ld changes", num_slots, num_walkers, churn_names[churn], churned / accesses,
+           max_pass, sd.changes);
+    if (ipis >= 0)
+        printf(", %ld shootdown IPIs", ipis);
+    if (sd.changes > 0)
+        printf(", %.0f walker ns lost per change", (double)(churned - base) / sd.changes);
+    printf("\n");
+}
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <num_pages> <trials>\n", argv[0]);
+    alloc_mode_t mode = MODE_PAGE;
+    access_order_t order = ORDER_SEQ;
+    size_t stride = 0;
+    long target_ms = DEFAULT_TARGET_MS;
+    int num_walkers = 0;
+    churn_kind_t churn = CHURN_MPROTECT;
+    int data_node = -1, pt_node = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:o:s:T:t:c:n:p:")) != -1) {
+        switch (opt) {
+        case 'm':
+            mode = parse_name(optarg, mode_names, 3);
+            break;
+        case 'o':
+            order = parse_name(optarg, order_names, 3);
+            break;
+        case 's':
+            stride = strtoul(optarg, NULL, 0);
+            break;
+        case 'T':
+            target_ms = atol(optarg);
+            break;
+        case 't':
+            num_walkers = atoi(optarg);
+            break;
+        case 'c':
+            churn = parse_name(optarg, churn_names, 2);
+            break;
+        case 'n':
+            data_node = atoi(optarg);
+            break;
+        case 'p':
+            pt_node = atoi(optarg);
+            break;
+        default:
+            mode = -1;
+        }
+        if ((int)mode < 0 || (int)order < 0 || (int)churn < 0)
+            break;
+    }
+    int nargs = argc - optind;
+    if ((nargs != 1 && nargs != 2) || (int)mode < 0 || (int)order < 0 || (int)churn < 0) {
+        fprintf(stderr, "Usage: %s [-m page|hugetlb|thp] [-o seq|rand|chase] [-s stride] "
+                "[-T target_ms]\n"
+                "          [-t walkers [-c mprotect|munmap]] [-n data_node] [-p page_table_node] "
+                "<num_pages> [trials]\n", argv[0]);
+        exit(1);
+    }
+    // Walkers share the slots, so they may only read them
+    if (num_walkers < 0 || (num_walkers > 0 && order != ORDER_CHASE)) {
+        fprintf(stderr, "-t needs a positive number of walkers and -o chase\n");
+        exit(1);
+    }
+    if (data_node >= MAX_NODES || pt_node >= MAX_NODES) {
+        fprintf(stderr, "node must be below %d\n", MAX_NODES);
         exit(1);
     }
 
-    int num_pages = atoi(argv[1]);
-    long long trials = atoll(argv[2]);
+    // Without a trial count, run for about target_ms
+    int num_slots = atoi(argv[optind]);
+    long long trials = (nargs == 2) ? atoll(argv[optind + 1]) : 0;
+    if (num_slots <= 0 || (nargs == 2 && trials <= 0) || target_ms <= 0) {
+        fprintf(stderr, "num_pages, trials and target_ms must be positive\n");
+        exit(1);
+    }
 
     // --- Q6: Pin to a single CPU (CPU 0) ---
     cpu_set_t set;
@@ -25,43 +503,135 @@ int main(int argc, char *argv[]) {
         // not fatal; just continue
     }
 
-    int jump = PAGESIZE / sizeof(int);
-    int *a = malloc((size_t)num_pages * PAGESIZE);
-    if (a == NULL) {
-        perror("malloc");
+    size_t pagesize = (mode == MODE_PAGE) ? (size_t)sysconf(_SC_PAGESIZE) : huge_page_size();
+    // -s packs the slots stride bytes apart instead of one per page, so
+    // many share a page: with -s 64 the sweep measures the caches, not
+    // the TLB
+    if (stride != 0 && (stride % CACHE_LINE != 0 || stride > pagesize)) {
+        fprintf(stderr, "stride must be a multiple of %d up to %zu\n", CACHE_LINE, pagesize);
+        exit(1);
+    }
+    size_t span = stride ? stride : pagesize;
+    size_t bytes = ((size_t)num_slots * span + pagesize - 1) / pagesize * pagesize;
+
+    // Page tables are allocated under the thread's policy when the pages
+    // are first touched below, data pages under the mapping's, so -p and
+    // -n place them independently: remote data, remote page walks or both
+    if (pt_node >= 0 && set_node_policy(pt_node) != 0) {
+        perror("set_mempolicy");
+        exit(1);
+    }
+    char *base = alloc_pages(mode, bytes, pagesize);
+    if (base == NULL)
+        exit(1);
+    if (data_node >= 0 && bind_to_node(base, bytes, data_node) != 0) {
+        perror("mbind");
+        fprintf(stderr, "is node %d online with memory? see /sys/devices/system/node\n", data_node);
         exit(1);
     }
 
-    // Initialize each page once to avoid page faults
-    for (int i = 0; i < num_pages * jump; i += jump)
-        a[i] = 0;
+    // One slot per page. Slots move down one cache line per page so they
+    // don't all land in the same cache set, which would add cache misses
+    // to what is meant to be a TLB measurement.
+    size_t lines = pagesize / CACHE_LINE;
+    int *visit = malloc(num_slots * sizeof(int));
+    int **slots = malloc(num_slots * sizeof(int *));
+    if (visit == NULL || slots == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (int i = 0; i < num_slots; i++)
+        visit[i] = i;
+    if (order != ORDER_SEQ)
+        shuffle(visit, num_slots);
+    for (int i = 0; i < num_slots; i++) {
+        int slot = visit[i];
+        if (stride)
+            slots[i] = (int *)(base + (size_t)slot * stride);
+        else
+            slots[i] = (int *)(base + (size_t)slot * pagesize + (slot % lines) * CACHE_LINE);
+    }
 
-    struct timeval start, end;
+    // Initialize each page once to avoid page faults; for chase, link the
+    // slots into one cycle in visiting order
+    for (int i = 0; i < num_slots; i++) {
+        if (order == ORDER_CHASE)
+            *(void **)slots[i] = slots[(i + 1) % num_slots];
+        else
+            *slots[i] = 0;
+    }
+    if (pt_node >= 0)
+        set_node_policy(-1);
+    if (data_node >= 0 && page_node(base) != data_node)
+        fprintf(stderr, "warning: data landed on node %d, not %d\n", page_node(base), data_node);
 
-    // --- Q5: Prevent compiler optimization ---
-    // Use 'volatile' so compiler cannot remove the loop
-    volatile int sink = 0;
+    if (mode == MODE_THP && thp_backed_kb(base) == 0)
+        fprintf(stderr, "warning: no transparent huge pages in the mapping; check "
+                "/sys/kernel/mm/transparent_hugepage/enabled\n");
 
-    gettimeofday(&start, NULL);
+    if (trials == 0)
+        trials = calibrate_trials(slots, num_slots, order, target_ms * 1000000L);
 
-    for (long long t = 0; t < trials; t++) {
-        for (int i = 0; i < num_pages * jump; i += jump) {
-            a[i] += 1;
-            sink += a[i];  // ensure side effect is visible
-        }
+    if (num_walkers > 0) {
+        shootdown(slots, num_slots, order, trials, num_walkers, churn);
+        free(slots);
+        free(visit);
+        munmap(base, bytes);
+        return 0;
     }
 
-    gettimeofday(&end, NULL);
+    // Measured dTLB misses for the timed loop, to confirm a cliff in
+    // ns/access is really the TLB. Some CPUs only count load misses.
+    int dtlb_fds[2] = {
+        open_dtlb_counter(PERF_COUNT_HW_CACHE_OP_READ),
+        open_dtlb_counter(PERF_COUNT_HW_CACHE_OP_WRITE),
+    };
+
+    for (int i = 0; i < 2; i++)
+        if (dtlb_fds[i] >= 0)
+            ioctl(dtlb_fds[i], PERF_EVENT_IOC_ENABLE, 0);
 
-    double elapsed_us = (end.tv_sec - start.tv_sec) * 1e6 +
-                        (end.tv_usec - start.tv_usec);
-    double per_access_ns = (elapsed_us * 1000) / (num_pages * trials);
+    // --- Q5: Prevent compiler optimization ---
+    // walk() puts an OPAQUE() barrier after every access, so it can be
+    // built with -O2 and still makes every access it is asked to
+    long elapsed_ns = walk(slots, num_slots, order, trials);
 
-    printf("%d pages, %.2f ns per access\n", num_pages, per_access_ns);
+    long long dtlb_misses = 0;
+    int have_dtlb = 0;
+    for (int i = 0; i < 2; i++) {
+        long long count;
+        if (dtlb_fds[i] < 0)
+            continue;
+        ioctl(dtlb_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(dtlb_fds[i], &count, sizeof(count)) == sizeof(count)) {
+            dtlb_misses += count;
+            have_dtlb = 1;
+        }
+        close(dtlb_fds[i]);
+    }
 
-    // print sink so compiler really can't skip it
-    if (sink == 0x12345678) printf("sink=%d\n", sink);
+    double per_access_ns = (double)elapsed_ns / ((double)num_slots * trials);
+
+    // The first seven fields keep their positions for tlb_characterize.py
+    const char *unit = stride ? "slots" : "pages";
+    if (have_dtlb)
+        printf("%d %s, %.2f ns per access, %.4f dTLB misses per access", num_slots, unit,
+               per_access_ns, (double)dtlb_misses / ((double)num_slots * trials));
+    else
+        printf("%d %s, %.2f ns per access, n/a dTLB misses per access", num_slots, unit,
+               per_access_ns);
+    printf(", %zu B pages (%s), %s order, %lld trials", pagesize, mode_names[mode],
+           order_names[order], trials);
+    if (data_node >= 0 || pt_node >= 0) {
+        printf(", data on node %d", page_node(base));
+        if (pt_node >= 0)
+            printf(", page tables on node %d", pt_node);
+        printf(", CPU on node %d", current_node());
+    }
+    printf("\n");
 
-    free((void *)a);
+    free(slots);
+    free(visit);
+    munmap(base, bytes);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,332 @@
+#! /usr/bin/env python3
+
+# Characterize the TLB and caches with tlb.c and print what was found as
+# JSON.
+#
+# Three pointer-chasing sweeps, each starting at powers of two:
+#
+#   cache   slots 64 B apart (tlb -s 64), on THP when available so a few
+#           huge pages cover the whole array: latency steps are cache sizes
+#   page    one slot per 4 KiB page: steps are L1 dTLB and L2 STLB reach
+#   thp     one slot per 2 MiB transparent huge page: the same for huge
+#           page entries
+#
+# Where latency jumps between two powers of two, the sweep bisects
+# between them until the onset of the jump is pinned down to --resolution.
+# Every point is the median of --repeats runs, and each run's trial count
+# is scaled by tlb itself to take about --target-ms. The page sweep also
+# touches one cache line per page, so its steps whose footprint (pages x
+# 64 B) lines up with a cache step are reported as caches, not TLB.
+
+from __future__ import print_function
+import argparse
+import json
+import os
+import platform
+import re
+import statistics
+import subprocess
+import sys
+
+CACHE_LINE = 64
+PAGE_LEVELS = ['l1_dtlb', 'l2_stlb']
+CACHE_MATCH = 1.5   # page-sweep step within this factor of a cache step
+
+
+# --- Utility functions ---
+def convert(size):
+    """Convert sizes like '1k', '4m', '32g' to integer bytes."""
+    size = str(size)
+    lastchar = size[-1]
+    if lastchar in ['k', 'K']:
+        return int(size[:-1]) * 1024
+    elif lastchar in ['m', 'M']:
+        return int(size[:-1]) * 1024 * 1024
+    elif lastchar in ['g', 'G']:
+        return int(size[:-1]) * 1024 * 1024 * 1024
+    else:
+        return int(size)
+
+
+def log(msg):
+    print(msg, file=sys.stderr)
+
+
+def compile_tlb(src, exe):
+    cmd = ['gcc', '-O2', '-Wall', '-std=c11', '-pthread', '-o', exe, src]
+    log(' '.join(cmd))
+    subprocess.check_call(cmd)
+
+
+def thp_available():
+    try:
+        with open('/sys/kernel/mm/transparent_hugepage/enabled') as f:
+            return '[never]' not in f.read()
+    except IOError:
+        return False
+
+
+def cpu_model():
+    try:
+        with open('/proc/cpuinfo') as f:
+            for line in f:
+                if line.startswith('model name'):
+                    return line.split(':', 1)[1].strip()
+    except IOError:
+        pass
+    return platform.processor()
+
+
+# "<n> pages, <ns> ns per access, <misses> dTLB misses per access,
+#  <size> B pages (<mode>), <order> order, <trials> trials"
+LINE = re.compile(r'^(\d+) \w+, ([\d.]+) ns per access, (\S+) dTLB misses per access, '
+                  r'(\d+) B pages \((\w+)\), (\w+) order, (\d+) trials')
+
+
+# --- Measurement ---
+class Sweep(object):
+    def __init__(self, name, exe, mode, stride, args):
+        self.name = name
+        self.exe = exe
+        self.mode = mode
+        self.stride = stride
+        self.args = args
+        self.points = {}        # slots -> point
+        self.page_bytes = None
+        self.warned = False
+
+    def measure(self, n):
+        if n in self.points:
+            return self.points[n]
+        cmd = [self.exe, '-m', self.mode, '-o', self.args.order,
+               '-T', str(self.args.target_ms)]
+        if self.stride:
+            cmd += ['-s', str(self.stride)]
+        cmd.append(str(n))
+        runs, misses, trials = [], [], []
+        for _ in range(self.args.repeats):
+            p = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                               universal_newlines=True)
+            m = LINE.match(p.stdout)
+            if 'warning' in p.stderr and not self.warned:
+                log('%s: %s' % (self.name, p.stderr.strip()))
+                self.warned = True
+            if p.returncode != 0 or m is None:
+                log('%s: %s failed: %s' % (self.name, ' '.join(cmd), p.stderr.strip()))
+                return None
+            runs.append(float(m.group(2)))
+            if m.group(3) != 'n/a':
+                misses.append(float(m.group(3)))
+            trials.append(int(m.group(7)))
+            self.page_bytes = int(m.group(4))
+        point = {
+            'slots': n,
+            'bytes': n * (self.stride or self.page_bytes),
+            'ns_median': statistics.median(runs),
+            'ns_stdev': statistics.stdev(runs) if len(runs) > 1 else 0.0,
+            'dtlb_misses_per_access': statistics.median(misses) if misses else None,
+            'trials': trials,
+        }
+        self.points[n] = point
+        log('%-5s %8d slots  %8.2f ns  (stdev %.2f)' %
+            (self.name, n, point['ns_median'], point['ns_stdev']))
+        return point
+
+    def curve(self):
+        return [self.points[n] for n in sorted(self.points)]
+
+    # Powers of two from lo to hi, stopping at the first failed run
+    def coarse(self, lo, hi):
+        n = lo
+        while n <= hi:
+            if self.measure(n) is None:
+                break
+            n *= 2
+        return sorted(self.points)
+
+    # b is a step up from a: by factor, and by more than a's noise
+    def rises(self, a, b, factor):
+        pa, pb = self.points[a], self.points[b]
+        return pb['ns_median'] > pa['ns_median'] * factor and \
+            pb['ns_median'] - pa['ns_median'] > 3 * pa['ns_stdev']
+
+    # Bisect (lo, hi) for the largest count still within the onset level
+    def refine(self, lo, hi, onset):
+        while hi - lo > max(1, int(lo * self.args.resolution)):
+            mid = int(round((lo * hi) ** 0.5))
+            mid = min(max(mid, lo + 1), hi - 1)
+            point = self.measure(mid)
+            if point is None:
+                break
+            if point['ns_median'] > onset:
+                hi = mid
+            else:
+                lo = mid
+        return lo
+
+    def knees(self, lo, hi, merge=False):
+        """Latency steps between consecutive powers of two, each refined to
+        the last count before latency is a quarter of the way up the step
+        (and at least threshold / 2 above where it started). A step must
+        persist to the next power of two. Steps one doubling apart stay
+        separate, since that is how close a cache and a TLB step can be in
+        the page sweep, unless merge is set: cache sizes are further apart
+        than that, so in the cache sweep they are one step."""
+        coarse = self.coarse(lo, hi)
+        found = []
+        last = None
+        for i, (a, b) in enumerate(zip(coarse, coarse[1:])):
+            if not self.rises(a, b, 1 + self.args.threshold):
+                continue
+            # A single slow point is noise, not a step: latency has to stay up
+            if i + 2 < len(coarse) and not self.rises(a, coarse[i + 2], 1 + self.args.threshold):
+                continue
+            before = self.points[a]['ns_median']
+            after = self.points[b]['ns_median']
+            if merge and last == a:
+                found[-1]['ns_after'] = round(after, 2)
+                found[-1]['miss_ns'] = round(after - found[-1]['ns_before'], 2)
+                last = b
+                continue
+            last = b
+            onset = before + max(before * self.args.threshold / 2, (after - before) / 4)
+            n = self.refine(a, b, onset)
+            found.append({
+                'slots': n,
+                'bytes': n * (self.stride or self.page_bytes),
+                'ns_before': round(before, 2),
+                'ns_after': round(after, 2),
+                'miss_ns': round(after - before, 2),
+            })
+        return found
+
+
+# --- Classification ---
+def explained_by_cache(footprint, caches):
+    for c in caches:
+        if c['bytes'] / CACHE_MATCH <= footprint <= c['bytes'] * CACHE_MATCH:
+            return c['level']
+    return None
+
+
+def classify_tlb(sweep, knees, caches):
+    result = {'page_bytes': sweep.page_bytes}
+    levels = iter(PAGE_LEVELS)
+    for k in knees:
+        # One cache line per page: this many lines are live at the step
+        footprint = k['slots'] * CACHE_LINE
+        level = explained_by_cache(footprint, caches)
+        if level is not None:
+            k['footprint_bytes'] = footprint
+            k['explained_by'] = 'L%d cache' % level
+            result.setdefault('cache_steps', []).append(k)
+            continue
+        name = next(levels, None)
+        entry = {
+            'entries': k['slots'],
+            'reach_bytes': k['slots'] * sweep.page_bytes,
+            'miss_ns': k['miss_ns'],
+            'ns_before': k['ns_before'],
+            'ns_after': k['ns_after'],
+        }
+        if name is None:
+            result.setdefault('other', []).append(entry)
+        else:
+            result[name] = entry
+    return result
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description='Infer TLB and cache sizes with tlb.c')
+    parser.add_argument('-o', '--output', help='write JSON here instead of stdout')
+    parser.add_argument('--modes', default='cache,page,thp',
+                        help='sweeps to run: cache, page, thp, hugetlb (default %(default)s)')
+    parser.add_argument('--order', default='chase', choices=['seq', 'rand', 'chase'],
+                        help='access order (default %(default)s)')
+    parser.add_argument('--target-ms', type=int, default=20,
+                        help='time per run; tlb scales its trials to it (default %(default)s)')
+    parser.add_argument('--repeats', type=int, default=5,
+                        help='runs per point; the median is used (default %(default)s)')
+    parser.add_argument('--threshold', type=float, default=0.2,
+                        help='latency rise per doubling that marks a step (default %(default)s)')
+    parser.add_argument('--resolution', type=float, default=0.05,
+                        help='refine steps to this fraction of their size (default %(default)s)')
+    parser.add_argument('--max-pages', default='16384', help='page sweep limit (default %(default)s)')
+    parser.add_argument('--max-huge-pages', default='256',
+                        help='thp/hugetlb sweep limit (default %(default)s)')
+    parser.add_argument('--max-cache', default='256m', help='cache sweep limit (default %(default)s)')
+    parser.add_argument('--tlb', default=os.path.join(here, 'tlb'), help='tlb binary to build and run')
+    parser.add_argument('--no-compile', action='store_true', help='use --tlb as it is')
+    args = parser.parse_args()
+
+    if not args.no_compile:
+        compile_tlb(os.path.join(here, 'tlb.c'), args.tlb)
+    modes = [m.strip() for m in args.modes.split(',') if m.strip()]
+
+    result = {
+        'host': {'cpu': cpu_model(), 'kernel': platform.release()},
+        'settings': {
+            'order': args.order,
+            'target_ms': args.target_ms,
+            'repeats': args.repeats,
+            'threshold': args.threshold,
+            'resolution': args.resolution,
+        },
+        'caches': [],
+        'tlb': {},
+        'curves': {},
+    }
+
+    if 'cache' in modes:
+        # On THP the array needs few TLB entries, so TLB misses don't add
+        # steps of their own
+        backing = 'thp' if thp_available() else 'page'
+        sweep = Sweep('cache', args.tlb, backing, CACHE_LINE, args)
+        knees = sweep.knees(64, convert(args.max_cache) // CACHE_LINE, merge=True)
+        for level, k in enumerate(knees, 1):
+            result['caches'].append({
+                'level': level,
+                'bytes': k['bytes'],
+                'miss_ns': k['miss_ns'],
+                'ns_before': k['ns_before'],
+                'ns_after': k['ns_after'],
+            })
+        result['settings']['cache_backing'] = backing
+        result['curves']['cache'] = sweep.curve()
+
+    for mode in ['page', 'thp', 'hugetlb']:
+        if mode not in modes:
+            continue
+        limit = convert(args.max_pages if mode == 'page' else args.max_huge_pages)
+        sweep = Sweep(mode, args.tlb, mode, 0, args)
+        knees = sweep.knees(1, limit)
+        if sweep.page_bytes is None:
+            log('%s: no successful runs, skipped' % mode)
+            continue
+        result['tlb'][mode] = classify_tlb(sweep, knees, result['caches'])
+        result['curves'][mode] = sweep.curve()
+
+    text = json.dumps(result, indent=2)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text + '\n')
+    else:
+        print(text)
+
+    for c in result['caches']:
+        log('L%d cache: %d KiB, +%.2f ns per access beyond it' %
+            (c['level'], c['bytes'] // 1024, c['miss_ns']))
+    for mode, t in result['tlb'].items():
+        for name in PAGE_LEVELS:
+            if name in t:
+                e = t[name]
+                log('%-7s %s: %d entries of %d B (reach %d KiB), +%.2f ns per access beyond it' %
+                    (mode, name, e['entries'], t['page_bytes'], e['reach_bytes'] // 1024,
+                     e['miss_ns']))
+        for e in t.get('other', []):
+            log('%-7s unclassified step at %d pages, +%.2f ns per access beyond it' %
+                (mode, e['entries'], e['miss_ns']))
+
+if __name__ == '__main__':
+    main()
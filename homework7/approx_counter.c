@@ -1,28 +1,121 @@
+#define _GNU_SOURCE
+#include "bench.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <pthread.h>
-#include <sys/time.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
 
 #define MAX_THREADS 64
+#define CACHE_LINE 64
+#define IDLE_NS 10000000L      // adaptive: threshold halves per this much idle time
+#define SAMPLE_NS 5000000L     // adaptive: threshold trajectory sampling period
+#define MAX_SAMPLES 256
+#define MAX_GROUPS 16
 
 typedef struct {
     pthread_mutex_t lock;
     long value;
 } counter_t;
 
+// Per-thread adaptive threshold state, written under locks[i] by its
+// owner or by a reader flushing the idle slot
+typedef struct {
+    atomic_int threshold;
+    long last_reads;
+    long last_flush_ns;
+} __attribute__((aligned(CACHE_LINE))) adapt_slot_t;
+
 typedef struct {
     pthread_mutex_t locks[MAX_THREADS];
     long local[MAX_THREADS];
     counter_t global;
     int threshold;
     int num_cpus;
+    // Adaptive mode: each thread's threshold doubles when it finds
+    // global.lock contended and halves when the counter is being read or
+    // once per IDLE_NS the thread has gone without flushing, never
+    // exceeding max_threshold so the total unflushed count stays within
+    // max_error. A thread that stops incrementing can't flush itself, so
+    // approx_get flushes and lowers idle slots on its behalf.
+    int adaptive;
+    int max_threshold;
+    atomic_long reads;
+    adapt_slot_t adapt[MAX_THREADS];
 } approx_counter_t;
 
+// One cache line per thread so neighbouring slots never false-share
 typedef struct {
-    approx_counter_t *counter;
-    int thread_id;
-    int num_increments;
-} thread_arg_t;
+    atomic_long value;
+} __attribute__((aligned(CACHE_LINE))) padded_slot_t;
+
+// Lock-free variant: each slot is written only by its owning thread, so
+// increments need no lock, and a full slot is flushed with one fetch_add.
+// Flushes are bracketed by flush_begin/flush_end (a multi-writer seqlock)
+// so an exact reader can detect one racing with its snapshot.
+typedef struct {
+    int threshold;
+    int num_cpus;
+    atomic_long global __attribute__((aligned(CACHE_LINE)));
+    atomic_ulong flush_begin;
+    atomic_ulong flush_end;
+    padded_slot_t local[MAX_THREADS];
+} padded_counter_t;
+
+// Hierarchical variant: thread slots flush into their group's node (one
+// per socket, or per core group), and a group node flushes into the root
+// once it holds group_threshold. Cross-group traffic drops by roughly
+// the number of threads per group.
+typedef struct {
+    int threshold;
+    long group_threshold;
+    int num_cpus;
+    int num_groups;
+    int group_of[MAX_THREADS];
+    atomic_long root __attribute__((aligned(CACHE_LINE)));
+    padded_slot_t groups[MAX_GROUPS];
+    padded_slot_t local[MAX_THREADS];
+} tree_counter_t;
+
+// Tree group of each worker; the harness pins thread i to the i-th
+// allowed CPU (round-robin), and group_of[i] is that CPU's group
+typedef struct {
+    int group_of[MAX_THREADS];
+    int num_groups;
+} placement_t;
+
+typedef enum {
+    MODE_LOCKED,
+    MODE_PADDED,
+    MODE_TREE,
+} counter_mode_t;
+
+static const char *mode_names[] = {
+    [MODE_LOCKED] = "Locked",
+    [MODE_PADDED] = "Padded",
+    [MODE_TREE]   = "Tree",
+};
+
+typedef struct {
+    int poll_hz;
+    int exact;
+    long max_error;   // > 0 enables the adaptive threshold
+    int group_size;   // > 0 groups this many CPUs instead of by socket
+    bench_format_t format;
+} options_t;
+
+// Concurrent monitoring thread for the reader benchmark
+typedef struct {
+    void *counter;
+    counter_mode_t mode;
+    int poll_hz;
+    int exact;
+    atomic_int stop;
+    long reads;
+    long max_error;
+} reader_arg_t;
 
 void init_counter(counter_t *c) {
     pthread_mutex_init(&c->lock, NULL);
@@ -31,93 +124,607 @@ void init_counter(counter_t *c) {
 
 void init_approx_counter(approx_counter_t *ac, int threshold, int num_cpus) {
     init_counter(&ac->global);
+    LOCK_PROFILE_NAME(&ac->global.lock, "global");
     ac->threshold = threshold;
     ac->num_cpus = num_cpus;
+    ac->adaptive = 0;
+    atomic_init(&ac->reads, 0);
     for (int i = 0; i < num_cpus; i++) {
         pthread_mutex_init(&ac->locks[i], NULL);
+        LOCK_PROFILE_NAME(&ac->locks[i], "local %d", i);
         ac->local[i] = 0;
     }
 }
 
+// Switch to per-thread adaptive thresholds, starting from the configured
+// one, with the sum of all thresholds bounded by max_error
+void approx_set_adaptive(approx_counter_t *ac, long max_error) {
+    ac->adaptive = 1;
+    ac->max_threshold = max_error / ac->num_cpus;
+    if (ac->max_threshold < 1) {
+        ac->max_threshold = 1;
+    }
+    int start = ac->threshold < ac->max_threshold ? ac->threshold : ac->max_threshold;
+    long now = bench_now_ns();
+    for (int i = 0; i < ac->num_cpus; i++) {
+        atomic_init(&ac->adapt[i].threshold, start);
+        ac->adapt[i].last_reads = 0;
+        ac->adapt[i].last_flush_ns = now;
+    }
+}
+
+// Halve t once per IDLE_NS of idle_ns, down to 1
+static int approx_decay(int t, long idle_ns) {
+    for (long n = idle_ns / IDLE_NS; n > 0 && t > 1; n--) {
+        t /= 2;
+    }
+    return t;
+}
+
+// Called by the owning thread after each flush
+void approx_adapt(approx_counter_t *ac, int thread_id, int contended) {
+    adapt_slot_t *a = &ac->adapt[thread_id];
+    int t = atomic_load_explicit(&a->threshold, memory_order_relaxed);
+    long now = bench_now_ns();
+    long reads = atomic_load_explicit(&ac->reads, memory_order_relaxed);
+    
+    if (contended) {
+        t = (t * 2 < ac->max_threshold) ? t * 2 : ac->max_threshold;
+    } else if (now - a->last_flush_ns > IDLE_NS) {
+        t = approx_decay(t, now - a->last_flush_ns);
+    } else if (reads != a->last_reads) {
+        t = (t / 2 > 1) ? t / 2 : 1;
+    }
+    
+    a->last_reads = reads;
+    a->last_flush_ns = now;
+    atomic_store_explicit(&a->threshold, t, memory_order_relaxed);
+}
+
+// Called by a reader holding locks[thread_id]: a slot that hasn't flushed
+// for IDLE_NS is flushed now and its threshold lowered for the time it sat
+// idle, so a stopped thread doesn't hold threshold-1 counts forever
+static void approx_flush_idle(approx_counter_t *ac, int thread_id, long now) {
+    adapt_slot_t *a = &ac->adapt[thread_id];
+    long idle = now - a->last_flush_ns;
+    if (idle <= IDLE_NS) {
+        return;
+    }
+    if (ac->local[thread_id] > 0) {
+        pthread_mutex_lock(&ac->global.lock);
+        ac->global.value += ac->local[thread_id];
+        pthread_mutex_unlock(&ac->global.lock);
+        ac->local[thread_id] = 0;
+    }
+    int t = atomic_load_explicit(&a->threshold, memory_order_relaxed);
+    atomic_store_explicit(&a->threshold, approx_decay(t, idle), memory_order_relaxed);
+    a->last_flush_ns = now;
+}
+
+long approx_threshold_sum(approx_counter_t *ac) {
+    long sum = 0;
+    for (int i = 0; i < ac->num_cpus; i++) {
+        sum += atomic_load_explicit(&ac->adapt[i].threshold, memory_order_relaxed);
+    }
+    return sum;
+}
+
 void approx_increment(approx_counter_t *ac, int thread_id) {
     pthread_mutex_lock(&ac->locks[thread_id]);
     ac->local[thread_id]++;
     
-    if (ac->local[thread_id] >= ac->threshold) {
-        pthread_mutex_lock(&ac->global.lock);
+    int threshold = ac->adaptive
+        ? atomic_load_explicit(&ac->adapt[thread_id].threshold, memory_order_relaxed)
+        : ac->threshold;
+    
+    if (ac->local[thread_id] >= threshold) {
+        int contended = 0;
+        if (ac->adaptive) {
+            // A failed trylock is the contention signal
+            contended = pthread_mutex_trylock(&ac->global.lock) != 0;
+            if (contended) {
+                pthread_mutex_lock(&ac->global.lock);
+            }
+        } else {
+            pthread_mutex_lock(&ac->global.lock);
+        }
         ac->global.value += ac->local[thread_id];
         pthread_mutex_unlock(&ac->global.lock);
         ac->local[thread_id] = 0;
+        
+        if (ac->adaptive) {
+            approx_adapt(ac, thread_id, contended);
+        }
     }
     
     pthread_mutex_unlock(&ac->locks[thread_id]);
 }
 
 long approx_get(approx_counter_t *ac) {
+    atomic_fetch_add_explicit(&ac->reads, 1, memory_order_relaxed);
+    
     pthread_mutex_lock(&ac->global.lock);
     long total = ac->global.value;
     pthread_mutex_unlock(&ac->global.lock);
     
+    long now = ac->adaptive ? bench_now_ns() : 0;
     for (int i = 0; i < ac->num_cpus; i++) {
         pthread_mutex_lock(&ac->locks[i]);
+        // Counted here whether or not it is flushed: global was read above
         total += ac->local[i];
+        if (ac->adaptive) {
+            approx_flush_idle(ac, i, now);
+        }
         pthread_mutex_unlock(&ac->locks[i]);
     }
     
     return total;
 }
 
-void *worker(void *arg) {
-    thread_arg_t *a = (thread_arg_t *)arg;
-    for (int i = 0; i < a->num_increments; i++) {
-        approx_increment(a->counter, a->thread_id);
+// === Padded Lock-Free Counter ===
+
+void init_padded_counter(padded_counter_t *pc, int threshold, int num_cpus) {
+    pc->threshold = threshold;
+    pc->num_cpus = num_cpus;
+    atomic_init(&pc->global, 0);
+    atomic_init(&pc->flush_begin, 0);
+    atomic_init(&pc->flush_end, 0);
+    for (int i = 0; i < num_cpus; i++) {
+        atomic_init(&pc->local[i].value, 0);
     }
-    return NULL;
 }
 
-double get_time() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec + tv.tv_usec / 1000000.0;
+void padded_increment(padded_counter_t *pc, int thread_id) {
+    // Only the owner writes its slot, so a relaxed load/store pair is
+    // enough; the slot is atomic only so approx readers can see it
+    atomic_long *slot = &pc->local[thread_id].value;
+    long v = atomic_load_explicit(slot, memory_order_relaxed) + 1;
+    
+    if (v >= pc->threshold) {
+        atomic_fetch_add_explicit(&pc->flush_begin, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        atomic_fetch_add_explicit(&pc->global, v, memory_order_relaxed);
+        atomic_store_explicit(slot, 0, memory_order_relaxed);
+        atomic_fetch_add_explicit(&pc->flush_end, 1, memory_order_release);
+        return;
+    }
+    
+    atomic_store_explicit(slot, v, memory_order_relaxed);
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <num_threads> <num_increments> <threshold>\n", argv[0]);
-        return 1;
+long padded_get(padded_counter_t *pc) {
+    long total = atomic_load_explicit(&pc->global, memory_order_relaxed);
+    for (int i = 0; i < pc->num_cpus; i++) {
+        total += atomic_load_explicit(&pc->local[i].value, memory_order_relaxed);
+    }
+    return total;
+}
+
+// Read without taking any lock. The fast path loads only the global
+// count, so it never touches the writers' cache lines; every thread may
+// hold up to threshold - 1 unflushed increments, which bounds how far it
+// can lag. With exact set it instead sums every slot inside a seqlock
+// read section and retries if a flush raced with it, so the result is
+// the counter's value at some instant during the call. *max_error, if
+// not NULL, receives the staleness bound of the returned value.
+long padded_read(padded_counter_t *pc, int exact, long *max_error) {
+    if (!exact) {
+        if (max_error) {
+            *max_error = (long)pc->num_cpus * (pc->threshold - 1);
+        }
+        return atomic_load_explicit(&pc->global, memory_order_relaxed);
+    }
+    
+    long total;
+    unsigned long end, begin;
+    do {
+        end = atomic_load_explicit(&pc->flush_end, memory_order_acquire);
+        total = atomic_load_explicit(&pc->global, memory_order_relaxed);
+        for (int i = 0; i < pc->num_cpus; i++) {
+            total += atomic_load_explicit(&pc->local[i].value, memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        begin = atomic_load_explicit(&pc->flush_begin, memory_order_relaxed);
+    } while (begin != end);
+    
+    if (max_error) {
+        *max_error = 0;
+    }
+    return total;
+}
+
+// === Hierarchical Counter ===
+
+void init_tree_counter(tree_counter_t *tc, int threshold, int num_cpus,
+                       const placement_t *place) {
+    tc->threshold = threshold;
+    tc->num_cpus = num_cpus;
+    tc->num_groups = place->num_groups;
+    atomic_init(&tc->root, 0);
+    for (int g = 0; g < MAX_GROUPS; g++) {
+        atomic_init(&tc->groups[g].value, 0);
     }
     
-    int num_threads = atoi(argv[1]);
-    int num_increments = atoi(argv[2]);
-    int threshold = atoi(argv[3]);
+    int members[MAX_GROUPS] = { 0 };
+    for (int i = 0; i < num_cpus; i++) {
+        tc->group_of[i] = place->group_of[i];
+        members[place->group_of[i]]++;
+        atomic_init(&tc->local[i].value, 0);
+    }
+    // Flush a group about once per round of member flushes
+    int max_members = 1;
+    for (int g = 0; g < tc->num_groups; g++) {
+        if (members[g] > max_members) {
+            max_members = members[g];
+        }
+    }
+    tc->group_threshold = (long)threshold * max_members;
+}
+
+void tree_increment(tree_counter_t *tc, int thread_id) {
+    atomic_long *slot = &tc->local[thread_id].value;
+    long v = atomic_load_explicit(slot, memory_order_relaxed) + 1;
     
-    approx_counter_t counter;
-    init_approx_counter(&counter, threshold, num_threads);
+    if (v < tc->threshold) {
+        atomic_store_explicit(slot, v, memory_order_relaxed);
+        return;
+    }
     
-    pthread_t threads[num_threads];
-    thread_arg_t args[num_threads];
+    atomic_store_explicit(slot, 0, memory_order_relaxed);
+    atomic_long *group = &tc->groups[tc->group_of[thread_id]].value;
+    long g = atomic_fetch_add_explicit(group, v, memory_order_relaxed) + v;
+    if (g >= tc->group_threshold) {
+        // Whoever empties the group node carries its count to the root
+        long moved = atomic_exchange_explicit(group, 0, memory_order_relaxed);
+        if (moved) {
+            atomic_fetch_add_explicit(&tc->root, moved, memory_order_relaxed);
+        }
+    }
+}
+
+long tree_get(tree_counter_t *tc) {
+    long total = atomic_load_explicit(&tc->root, memory_order_relaxed);
+    for (int g = 0; g < tc->num_groups; g++) {
+        total += atomic_load_explicit(&tc->groups[g].value, memory_order_relaxed);
+    }
+    for (int i = 0; i < tc->num_cpus; i++) {
+        total += atomic_load_explicit(&tc->local[i].value, memory_order_relaxed);
+    }
+    return total;
+}
+
+// === Thread Placement ===
+
+// Socket of a CPU from sysfs, or 0 if topology is not exposed
+int cpu_package_id(int cpu) {
+    char path[128];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    FILE *f = fopen(path, "r");
+    int id = 0;
+    if (f) {
+        if (fscanf(f, "%d", &id) != 1) {
+            id = 0;
+        }
+        fclose(f);
+    }
+    return id;
+}
+
+// Group the harness's round-robin CPU assignment by socket, or into runs
+// of group_size CPUs if given
+void plan_placement(placement_t *p, int num_threads, int group_size) {
+    static int cpus[CPU_SETSIZE];
+    int n = bench_allowed_cpus(cpus, CPU_SETSIZE);
     
+    int keys[MAX_GROUPS];
+    p->num_groups = 0;
     for (int i = 0; i < num_threads; i++) {
-        args[i].counter = &counter;
-        args[i].thread_id = i;
-        args[i].num_increments = num_increments;
+        int idx = i % n;
+        int key = group_size > 0 ? idx / group_size : cpu_package_id(cpus[idx]);
+        int g = 0;
+        while (g < p->num_groups && keys[g] != key) {
+            g++;
+        }
+        if (g == p->num_groups) {
+            if (p->num_groups < MAX_GROUPS) {
+                keys[p->num_groups++] = key;
+            } else {
+                g = key % MAX_GROUPS;
+            }
+        }
+        p->group_of[i] = g;
     }
+}
+
+// === Benchmark ===
+
+// One benchmark case: a counter mode, optionally with a polling reader
+typedef struct {
+    counter_mode_t mode;
+    int num_increments;
+    int threshold;
+    int poll_hz;
+    const options_t *opt;
+    char name[64];
+} case_t;
+
+// State of one run
+typedef struct {
+    const case_t *c;
+    void *counter;
+    approx_counter_t ac;
+    padded_counter_t pc;
+    tree_counter_t tc;
+    int adaptive;
+    pthread_t reader_thread;
+    reader_arg_t r;
+    pthread_t sampler_thread;
+    atomic_int sampler_stop;
+    int num_threads;
+    long samples[MAX_SAMPLES];
+    int num_samples;
+} run_t;
+
+void worker(bench_thread_t *t, void *state) {
+    run_t *run = (run_t *)state;
+    void *counter = run->counter;
+    int id = t->id;
+    for (int i = 0; i < run->c->num_increments; i++) {
+        switch (run->c->mode) {
+        case MODE_LOCKED:
+            BENCH_OP(t, approx_increment(counter, id));
+            break;
+        case MODE_PADDED:
+            BENCH_OP(t, padded_increment(counter, id));
+            break;
+        case MODE_TREE:
+            BENCH_OP(t, tree_increment(counter, id));
+            break;
+        }
+    }
+}
+
+// Polls the counter at poll_hz until stopped. Rates too high to sleep
+// between (under 1 us apart) poll back to back.
+void *reader(void *arg) {
+    reader_arg_t *r = (reader_arg_t *)arg;
+    long interval_ns = 1000000000L / r->poll_hz;
+    struct timespec pause = { interval_ns / 1000000000L, interval_ns % 1000000000L };
     
-    double start = get_time();
+    while (!atomic_load_explicit(&r->stop, memory_order_relaxed)) {
+        long err = 0;
+        switch (r->mode) {
+        case MODE_LOCKED:
+            approx_get(r->counter);
+            break;
+        case MODE_PADDED:
+            padded_read(r->counter, r->exact, &err);
+            break;
+        case MODE_TREE:
+            tree_get(r->counter);
+            break;
+        }
+        if (err > r->max_error) {
+            r->max_error = err;
+        }
+        r->reads++;
+        if (interval_ns >= 1000) {
+            nanosleep(&pause, NULL);
+        }
+    }
+    return NULL;
+}
+
+// Average adaptive threshold every SAMPLE_NS until the run is torn down
+void *sample_thresholds(void *arg) {
+    run_t *run = (run_t *)arg;
+    struct timespec pause = { 0, SAMPLE_NS };
+    while (!atomic_load(&run->sampler_stop)) {
+        if (run->num_samples < MAX_SAMPLES) {
+            run->samples[run->num_samples++] = approx_threshold_sum(&run->ac) / run->num_threads;
+        }
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+void *counter_setup(const bench_run_info_t *info, void *ctx) {
+    case_t *c = (case_t *)ctx;
+    int num_threads = info->num_threads;
+    run_t *run = bench_alloc_state(sizeof(run_t));
+    run->c = c;
+    run->num_threads = num_threads;
+    run->num_samples = 0;
+    run->adaptive = (c->mode == MODE_LOCKED && c->opt->max_error > 0);
     
-    for (int i = 0; i < num_threads; i++) {
-        pthread_create(&threads[i], NULL, worker, &args[i]);
+    placement_t place;
+    plan_placement(&place, num_threads, c->opt->group_size);
+    
+    switch (c->mode) {
+    case MODE_LOCKED:
+        init_approx_counter(&run->ac, c->threshold, num_threads);
+        if (run->adaptive) {
+            approx_set_adaptive(&run->ac, c->opt->max_error);
+        }
+        run->counter = &run->ac;
+        break;
+    case MODE_PADDED:
+        init_padded_counter(&run->pc, c->threshold, num_threads);
+        run->counter = &run->pc;
+        break;
+    case MODE_TREE:
+        init_tree_counter(&run->tc, c->threshold, num_threads, &place);
+        run->counter = &run->tc;
+        break;
     }
     
-    for (int i = 0; i < num_threads; i++) {
-        pthread_join(threads[i], NULL);
+    reader_arg_t r = { .counter = run->counter, .mode = c->mode, .poll_hz = c->poll_hz,
+                       .exact = c->opt->exact };
+    run->r = r;
+    atomic_init(&run->r.stop, 0);
+    if (c->poll_hz > 0) {
+        pthread_create(&run->reader_thread, NULL, reader, &run->r);
     }
+    atomic_init(&run->sampler_stop, 0);
+    if (run->adaptive) {
+        pthread_create(&run->sampler_thread, NULL, sample_thresholds, run);
+    }
+    return run;
+}
+
+void counter_teardown(const bench_run_info_t *info, void *state) {
+    run_t *run = (run_t *)state;
+    const case_t *c = run->c;
     
-    double end = get_time();
-    long final = approx_get(&counter);
+    if (c->poll_hz > 0) {
+        atomic_store(&run->r.stop, 1);
+        pthread_join(run->reader_thread, NULL);
+    }
+    if (run->adaptive) {
+        atomic_store(&run->sampler_stop, 1);
+        pthread_join(run->sampler_thread, NULL);
+    }
     
-    printf("Threads: %d, Threshold: %d, Time: %.4f sec, Counter: %ld\n", 
-           num_threads, threshold, end - start, final);
+    // The final read flushes idle adaptive slots into global and lowers
+    // their thresholds, so take what the run left unflushed first
+    long flushed = run->adaptive ? run->ac.global.value : 0;
+    long bound = run->adaptive ? approx_threshold_sum(&run->ac) : 0;
+    long final = 0;
+    switch (c->mode) {
+    case MODE_LOCKED:
+        final = approx_get(&run->ac);
+        break;
+    case MODE_PADDED:
+        final = padded_get(&run->pc);
+        break;
+    case MODE_TREE:
+        final = tree_get(&run->tc);
+        break;
+    }
+    long expected = (long)run->num_threads * c->num_increments;
+    if (final != expected) {
+        fprintf(stderr, "%s: Counter: %ld, expected %ld\n", c->name, final, expected);
+    }
+    
+    if (info->last && c->opt->format == BENCH_TEXT) {
+        if (c->poll_hz > 0) {
+            printf("%s: Reads: %ld, Max staleness: %ld\n", c->name, run->r.reads,
+                   run->r.max_error);
+        }
+        if (c->mode == MODE_TREE && c->poll_hz == 0) {
+            printf("%s: %d groups, group flush at %ld\n", c->name, run->tc.num_groups,
+                   run->tc.group_threshold);
+        }
+        if (run->adaptive) {
+            // What a global-only read would miss right now, against the
+            // bound the current thresholds allow
+            printf("%s: Adaptive thresholds (avg every %ld ms):", c->name,
+                   SAMPLE_NS / 1000000);
+            for (int i = 0; i < run->num_samples; i++) {
+                printf(" %ld", run->samples[i]);
+            }
+            printf("\n%s: Final error: %ld (bound %ld, max_error %ld)\n", c->name,
+                   final - flushed, bound, c->opt->max_error);
+        }
+    }
+    free(run);
+}
+
+void run_mode(const bench_config_t *cfg, counter_mode_t mode, int num_increments,
+              int threshold, const options_t *opt) {
+    case_t base = { .mode = mode, .num_increments = num_increments,
+                    .threshold = threshold, .opt = opt };
+    snprintf(base.name, sizeof(base.name), "%s", mode_names[mode]);
+    bench_case_t bc = {
+        .name = base.name,
+        .setup = counter_setup,
+        .body = worker,
+        .teardown = counter_teardown,
+        .ctx = &base,
+    };
+    bench_result_t base_res[BENCH_MAX_SWEEP];
+    bench_run(cfg, &bc, base_res);
+    
+    if (opt->poll_hz > 0) {
+        case_t polled = base;
+        polled.poll_hz = opt->poll_hz;
+        snprintf(polled.name, sizeof(polled.name), "%s + reader", mode_names[mode]);
+        bc.name = polled.name;
+        bc.ctx = &polled;
+        bench_result_t polled_res[BENCH_MAX_SWEEP];
+        bench_run(cfg, &bc, polled_res);
+        
+        if (opt->format == BENCH_TEXT) {
+            for (int s = 0; s < cfg->num_thread_counts; s++) {
+                printf("%s: threads %d, reader slowdown %+.1f%%\n", mode_names[mode],
+                       base_res[s].num_threads,
+                       (polled_res[s].mean_sec / base_res[s].mean_sec - 1) * 100);
+            }
+        }
+    }
+}
+
+void usage(char *prog) {
+    fprintf(stderr, "Usage: %s [-p poll_hz] [-x] [-a max_error] [-g group_size] [options] "
+            "<num_threads> <num_increments> <threshold>\n"
+            "  -p  run a concurrent reader polling poll_hz times/sec\n"
+            "  -x  reader uses the exact (seqlock snapshot) read\n"
+            "  -a  adapt the locked counter's thresholds, keeping the\n"
+            "      unflushed total within max_error\n"
+            "  -g  tree counter groups every group_size CPUs instead of\n"
+            "      grouping by socket\n", prog);
+    bench_usage(stderr);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    bench_config_t cfg;
+    bench_config_init(&cfg);
+    options_t opts = { 0 };
+    int opt;
+    while ((opt = getopt(argc, argv, "p:xa:g:" BENCH_OPTSTRING)) != -1) {
+        switch (opt) {
+        case 'p':
+            opts.poll_hz = atoi(optarg);
+            break;
+        case 'x':
+            opts.exact = 1;
+            break;
+        case 'a':
+            opts.max_error = atol(optarg);
+            break;
+        case 'g':
+            opts.group_size = atoi(optarg);
+            break;
+        default:
+            if (!bench_option(&cfg, opt, optarg)) {
+                usage(argv[0]);
+            }
+        }
+    }
+    if (argc - optind != 3) {
+        usage(argv[0]);
+    }
+    if (!bench_parse_threads(&cfg, argv[optind], MAX_THREADS)) {
+        fprintf(stderr, "num_threads must be between 1 and %d\n", MAX_THREADS);
+        return 1;
+    }
+    opts.format = cfg.format;
+    
+    int num_increments = atoi(argv[optind + 1]);
+    int threshold = atoi(argv[optind + 2]);
+    
+    if (cfg.format == BENCH_TEXT) {
+        printf("Threads: %s, Increments: %d, Threshold: %d\n",
+               argv[optind], num_increments, threshold);
+        if (opts.poll_hz > 0) {
+            printf("Reader: %d Hz, %s\n", opts.poll_hz, opts.exact ? "exact" : "fast");
+        }
+    }
+    run_mode(&cfg, MODE_LOCKED, num_increments, threshold, &opts);
+    run_mode(&cfg, MODE_PADDED, num_increments, threshold, &opts);
+    run_mode(&cfg, MODE_TREE, num_increments, threshold, &opts);
     
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,168 @@
+#ifndef __arena_h__
+#define __arena_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Fixed-size object pool for node_t allocations.
+//
+// Each thread bump-allocates from its own slab of ARENA_CHUNK_SIZE chunks,
+// so consecutive allocations by one thread sit next to each other in
+// memory and no lock is taken. Freed objects go on the freeing thread's
+// free list and are reused first. arena_pool_destroy() releases every
+// chunk of every thread at once, so a table is torn down in one call.
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_THREADS    64           // threads beyond this share a locked slab
+#define ARENA_ALIGN      64
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+} arena_chunk_t;
+
+typedef struct arena_free {
+    struct arena_free *next;
+} arena_free_t;
+
+typedef struct {
+    arena_chunk_t *chunks;
+    char *cur;
+    char *end;
+    arena_free_t *free_list;
+} __attribute__((aligned(ARENA_ALIGN))) arena_slab_t;
+
+typedef struct {
+    size_t obj_size;
+    arena_slab_t slabs[ARENA_THREADS];
+    arena_slab_t shared;
+    pthread_mutex_t shared_lock;
+} arena_pool_t;
+
+// === Thread Slots ===
+// Slot ids are recycled when a thread exits, so repeated benchmark runs
+// that spawn fresh threads keep landing on the lock-free slabs.
+
+static atomic_ulong arena_slot_bits;
+static pthread_key_t arena_slot_key;
+static pthread_once_t arena_slot_once = PTHREAD_ONCE_INIT;
+static __thread int arena_slot = -1;
+
+static void arena_slot_release(void *v) {
+    unsigned long bit = 1UL << ((intptr_t)v - 1);
+    atomic_fetch_and_explicit(&arena_slot_bits, ~bit, memory_order_release);
+}
+
+static void arena_slot_key_init(void) {
+    pthread_key_create(&arena_slot_key, arena_slot_release);
+}
+
+static inline int arena_thread_slot(void) {
+    if (arena_slot >= 0) {
+        return arena_slot;
+    }
+
+    pthread_once(&arena_slot_once, arena_slot_key_init);
+    unsigned long bits = atomic_load_explicit(&arena_slot_bits, memory_order_relaxed);
+    while (~bits) {
+        int slot = __builtin_ctzl(~bits);
+        if (atomic_compare_exchange_weak_explicit(&arena_slot_bits, &bits,
+                                                  bits | (1UL << slot),
+                                                  memory_order_acquire,
+                                                  memory_order_relaxed)) {
+            pthread_setspecific(arena_slot_key, (void *)(intptr_t)(slot + 1));
+            arena_slot = slot;
+            return slot;
+        }
+    }
+    arena_slot = ARENA_THREADS;
+    return arena_slot;
+}
+
+// === Pool ===
+
+static inline void arena_pool_init(arena_pool_t *p, size_t obj_size) {
+    // Pointer-aligned, and big enough to hold the free-list link
+    obj_size = (obj_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    if (obj_size < sizeof(arena_free_t)) {
+        obj_size = sizeof(arena_free_t);
+    }
+    p->obj_size = obj_size;
+    for (int i = 0; i <= ARENA_THREADS; i++) {
+        arena_slab_t *s = (i < ARENA_THREADS) ? &p->slabs[i] : &p->shared;
+        s->chunks = NULL;
+        s->cur = s->end = NULL;
+        s->free_list = NULL;
+    }
+    pthread_mutex_init(&p->shared_lock, NULL);
+}
+
+static inline void *arena_slab_alloc(arena_pool_t *p, arena_slab_t *s) {
+    if (s->free_list) {
+        arena_free_t *f = s->free_list;
+        s->free_list = f->next;
+        return f;
+    }
+    if ((size_t)(s->end - s->cur) < p->obj_size) {
+        arena_chunk_t *c = aligned_alloc(ARENA_ALIGN, ARENA_CHUNK_SIZE);
+        if (!c) {
+            perror("aligned_alloc");
+            exit(1);
+        }
+        c->next = s->chunks;
+        s->chunks = c;
+        // Objects start on the cache line after the chunk header
+        s->cur = (char *)c + ARENA_ALIGN;
+        s->end = (char *)c + ARENA_CHUNK_SIZE;
+    }
+    void *obj = s->cur;
+    s->cur += p->obj_size;
+    return obj;
+}
+
+static inline void *arena_alloc(arena_pool_t *p) {
+    int slot = arena_thread_slot();
+    if (slot < ARENA_THREADS) {
+        return arena_slab_alloc(p, &p->slabs[slot]);
+    }
+    pthread_mutex_lock(&p->shared_lock);
+    void *obj = arena_slab_alloc(p, &p->shared);
+    pthread_mutex_unlock(&p->shared_lock);
+    return obj;
+}
+
+static inline void arena_free(arena_pool_t *p, void *obj) {
+    arena_free_t *f = obj;
+    int slot = arena_thread_slot();
+    if (slot < ARENA_THREADS) {
+        f->next = p->slabs[slot].free_list;
+        p->slabs[slot].free_list = f;
+        return;
+    }
+    pthread_mutex_lock(&p->shared_lock);
+    f->next = p->shared.free_list;
+    p->shared.free_list = f;
+    pthread_mutex_unlock(&p->shared_lock);
+}
+
+// Release every object from every thread. No thread may still be using
+// the pool.
+static inline void arena_pool_destroy(arena_pool_t *p) {
+    for (int i = 0; i <= ARENA_THREADS; i++) {
+        arena_slab_t *s = (i < ARENA_THREADS) ? &p->slabs[i] : &p->shared;
+        arena_chunk_t *c = s->chunks;
+        while (c) {
+            arena_chunk_t *next = c->next;
+            free(c);
+            c = next;
+        }
+        s->chunks = NULL;
+        s->cur = s->end = NULL;
+        s->free_list = NULL;
+    }
+    pthread_mutex_destroy(&p->shared_lock);
+}
+
+#endif // __arena_h__
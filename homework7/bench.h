@@ -0,0 +1,564 @@
+#ifndef __bench_h__
+#define __bench_h__
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     // cpu_set_t; include this header before system headers
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "perf_counters.h"
+#include "../threads-sema/lock_profile.h"
+
+// Shared benchmark driver for the homework7 programs.
+//
+// A program describes one benchmark as a bench_case_t: setup() builds the
+// state for a run with a given thread count, body() is what each thread
+// executes, and teardown() releases the state. bench_run() sweeps the
+// configured thread counts; for each it does warmup runs, then timed
+// repeats, with threads pinned round-robin to the allowed CPUs and
+// released together from a barrier. It reports throughput (mean and
+// stddev over the repeats), per-op latency percentiles from sampled ops,
+// and prints the row as text, CSV or JSON lines. With -e each thread also
+// counts hardware events over its timed region (see perf_counters.h); the
+// row then carries per-op averages and a per-thread breakdown.
+//
+// Common options, parsed by bench_option():
+//   -r N     timed repeats per thread count (default 3)
+//   -w N     warmup runs per thread count (default 1)
+//   -s N     time one op in every N for latency percentiles (default 64, 0 = off)
+//   -o FMT   output format: text, csv or json (default text)
+//   -P       do not pin threads to CPUs
+//   -e       count cycles, instructions, LLC/dTLB misses and context switches
+// The thread count argument of each program takes a comma-separated list
+// (e.g. 1,2,4,8) to sweep. Building with -DLOCK_PROFILE adds a per-lock
+// contention report at exit (see threads-sema/lock_profile.h).
+//
+// Programs using it build with: gcc -o foo foo.c -Wall -pthread -lm
+
+#define BENCH_OPTSTRING "r:w:s:o:Pe"
+#define BENCH_MAX_SWEEP 32
+#define BENCH_MAX_SAMPLES (1 << 16)   // per thread per run
+
+typedef enum {
+    BENCH_TEXT,
+    BENCH_CSV,
+    BENCH_JSON,
+} bench_format_t;
+
+typedef struct {
+    int threads[BENCH_MAX_SWEEP];
+    int num_thread_counts;
+    int repeats;
+    int warmup;
+    int sample_every;
+    int pin;
+    int perf;
+    bench_format_t format;
+} bench_config_t;
+
+// Per-thread context handed to body()
+typedef struct {
+    int id;
+    int num_threads;
+    int cpu;
+    long ops;
+    long *lat;
+    int num_lat;
+    int sample_every;
+    int countdown;
+} bench_thread_t;
+
+// Which run setup()/teardown() are being called for
+typedef struct {
+    int num_threads;
+    int run;           // 0-based, warmups first
+    int warmup;        // this run is a warmup
+    int last;          // final timed run for this thread count
+} bench_run_info_t;
+
+typedef struct {
+    const char *name;
+    void *(*setup)(const bench_run_info_t *info, void *ctx);
+    void (*body)(bench_thread_t *t, void *state);
+    void (*teardown)(const bench_run_info_t *info, void *state);
+    void *ctx;
+} bench_case_t;
+
+// Aggregate over the timed repeats of one thread count
+typedef struct {
+    int num_threads;
+    double mean_sec;
+    double stddev_sec;
+    double ops_per_sec;
+    double ops_per_sec_stddev;
+    long p50_ns;
+    long p99_ns;
+    long p999_ns;
+    double ops;                  // mean ops per run
+    perf_sample_t perf;          // mean event counts per run, all threads
+} bench_result_t;
+
+// Event counts of one thread in the last timed run
+typedef struct {
+    int cpu;
+    perf_sample_t sample;
+} bench_thread_perf_t;
+
+static bench_format_t bench_header_format = -1;
+
+static inline long bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Allocate a setup() state on a cache line boundary: run states hold
+// per-thread slots aligned to 64 bytes, and malloc only guarantees 16
+static inline void *bench_alloc_state(size_t size) {
+    void *p = aligned_alloc(64, (size + 63) / 64 * 64);
+    if (!p) {
+        perror("aligned_alloc");
+        exit(1);
+    }
+    return p;
+}
+
+// === Per-Op Latency Sampling ===
+
+static inline int bench_sample(bench_thread_t *t) {
+    if (t->sample_every <= 0 || --t->countdown > 0) {
+        return 0;
+    }
+    t->countdown = t->sample_every;
+    return t->num_lat < BENCH_MAX_SAMPLES;
+}
+
+// Run one operation inside body(), counting it and timing one in every
+// sample_every of them
+#define BENCH_OP(t, op)                                  \
+    do {                                                 \
+        if (bench_sample(t)) {                           \
+            long _bench_t0 = bench_now_ns();             \
+            op;                                          \
+            (t)->lat[(t)->num_lat++] =                   \
+                bench_now_ns() - _bench_t0;              \
+        } else {                                         \
+            op;                                          \
+        }                                                \
+        (t)->ops++;                                      \
+    } while (0)
+
+// === Configuration ===
+
+static inline void bench_config_init(bench_config_t *cfg) {
+    cfg->num_thread_counts = 0;
+    cfg->repeats = 3;
+    cfg->warmup = 1;
+    cfg->sample_every = 64;
+    cfg->pin = 1;
+    cfg->perf = 0;
+    cfg->format = BENCH_TEXT;
+}
+
+// Handle one of the BENCH_OPTSTRING options; returns 0 if opt is not ours
+static inline int bench_option(bench_config_t *cfg, int opt, const char *arg) {
+    switch (opt) {
+    case 'r':
+        cfg->repeats = atoi(arg) > 0 ? atoi(arg) : 1;
+        return 1;
+    case 'w':
+        cfg->warmup = atoi(arg) >= 0 ? atoi(arg) : 0;
+        return 1;
+    case 's':
+        cfg->sample_every = atoi(arg);
+        return 1;
+    case 'P':
+        cfg->pin = 0;
+        return 1;
+    case 'e':
+        cfg->perf = 1;
+        return 1;
+    case 'o':
+        if (strcmp(arg, "csv") == 0) {
+            cfg->format = BENCH_CSV;
+        } else if (strcmp(arg, "json") == 0) {
+            cfg->format = BENCH_JSON;
+        } else if (strcmp(arg, "text") == 0) {
+            cfg->format = BENCH_TEXT;
+        } else {
+            return 0;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// Parse "4" or "1,2,4,8"; returns 0 on a malformed or out-of-range list
+static inline int bench_parse_threads(bench_config_t *cfg, const char *list, int max) {
+    char *end;
+    cfg->num_thread_counts = 0;
+    while (*list) {
+        long n = strtol(list, &end, 10);
+        if (end == list || n < 1 || n > max || cfg->num_thread_counts == BENCH_MAX_SWEEP) {
+            return 0;
+        }
+        cfg->threads[cfg->num_thread_counts++] = n;
+        list = (*end == ',') ? end + 1 : end;
+    }
+    return cfg->num_thread_counts > 0;
+}
+
+static inline int bench_max_threads(const bench_config_t *cfg) {
+    int max = 0;
+    for (int i = 0; i < cfg->num_thread_counts; i++) {
+        if (cfg->threads[i] > max) {
+            max = cfg->threads[i];
+        }
+    }
+    return max;
+}
+
+static inline void bench_usage(FILE *out) {
+    fprintf(out,
+            "  -r N    timed repeats per thread count (default 3)\n"
+            "  -w N    warmup runs per thread count (default 1)\n"
+            "  -s N    sample latency of 1 in N ops (default 64, 0 = off)\n"
+            "  -o FMT  text, csv or json output (default text)\n"
+            "  -P      do not pin threads to CPUs\n"
+            "  -e      count hardware events (cycles, instructions, LLC and\n"
+            "          dTLB misses, context switches) per thread\n"
+            "  Thread counts may be a comma-separated list to sweep.\n");
+}
+
+// === Thread Placement ===
+
+// CPUs this process may run on, in order; thread i runs on cpus[i % n]
+static inline int bench_allowed_cpus(int *cpus, int max) {
+    cpu_set_t set;
+    int n = 0;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE && n < max; c++) {
+            if (CPU_ISSET(c, &set)) {
+                cpus[n++] = c;
+            }
+        }
+    }
+    if (n == 0) {
+        cpus[n++] = 0;
+    }
+    return n;
+}
+
+static inline void bench_pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        perror("sched_setaffinity");
+    }
+}
+
+// === Driver ===
+
+typedef struct {
+    bench_thread_t t;
+    const bench_case_t *bc;
+    void *state;
+    int pin;
+    int perf;
+    pthread_barrier_t *start;
+    long start_ns;
+    long end_ns;
+    perf_counters_t counters;
+    perf_sample_t sample;
+} bench_worker_t;
+
+static void *bench_worker(void *arg) {
+    bench_worker_t *w = (bench_worker_t *)arg;
+    if (w->pin) {
+        bench_pin_to_cpu(w->t.cpu);
+    }
+    if (w->perf) {
+        perf_counters_open(&w->counters);
+    }
+    pthread_barrier_wait(w->start);
+    if (w->perf) {
+        perf_counters_start(&w->counters);
+    }
+    w->start_ns = bench_now_ns();
+    w->bc->body(&w->t, w->state);
+    w->end_ns = bench_now_ns();
+    if (w->perf) {
+        perf_counters_stop(&w->counters, &w->sample);
+        perf_counters_close(&w->counters);
+    }
+    return NULL;
+}
+
+static int bench_cmp_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+// One run: returns elapsed seconds, adds the ops to *ops and, if lat is
+// not NULL, appends the latency samples to *lat/*num_lat. With perf
+// enabled, perf[i] receives thread i's event counts.
+static double bench_run_once(const bench_config_t *cfg, const bench_case_t *bc,
+                             const bench_run_info_t *info, long *ops,
+                             long **lat, long *num_lat, bench_thread_perf_t *perf) {
+    int n = info->num_threads;
+    static int cpus[CPU_SETSIZE];
+    int num_cpus = bench_allowed_cpus(cpus, CPU_SETSIZE);
+
+    void *state = bc->setup(info, bc->ctx);
+
+    pthread_t threads[n];
+    bench_worker_t workers[n];
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, n + 1);
+
+    for (int i = 0; i < n; i++) {
+        bench_worker_t *w = &workers[i];
+        w->t.id = i;
+        w->t.num_threads = n;
+        w->t.cpu = cpus[i % num_cpus];
+        w->t.ops = 0;
+        w->t.num_lat = 0;
+        w->t.sample_every = cfg->sample_every;
+        w->t.countdown = cfg->sample_every;
+        w->t.lat = cfg->sample_every > 0 ? malloc(BENCH_MAX_SAMPLES * sizeof(long)) : NULL;
+        w->bc = bc;
+        w->state = state;
+        w->pin = cfg->pin;
+        w->perf = cfg->perf;
+        w->start = &start;
+        pthread_create(&threads[i], NULL, bench_worker, w);
+    }
+
+    pthread_barrier_wait(&start);
+    for (int i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // From the first thread starting to the last one finishing; the main
+    // thread may not run again until well after the barrier opens
+    long t0 = workers[0].start_ns, t1 = workers[0].end_ns;
+    long samples = 0;
+    for (int i = 0; i < n; i++) {
+        samples += workers[i].t.num_lat;
+    }
+    if (lat && samples > 0) {
+        *lat = realloc(*lat, (*num_lat + samples) * sizeof(long));
+    }
+    for (int i = 0; i < n; i++) {
+        t0 = workers[i].start_ns < t0 ? workers[i].start_ns : t0;
+        t1 = workers[i].end_ns > t1 ? workers[i].end_ns : t1;
+        *ops += workers[i].t.ops;
+        if (lat) {
+            memcpy(*lat + *num_lat, workers[i].t.lat, workers[i].t.num_lat * sizeof(long));
+            *num_lat += workers[i].t.num_lat;
+        }
+        free(workers[i].t.lat);
+        if (cfg->perf) {
+            perf[i].cpu = workers[i].t.cpu;
+            perf[i].sample = workers[i].sample;
+        }
+    }
+    double elapsed = (t1 - t0) / 1e9;
+    pthread_barrier_destroy(&start);
+
+    bc->teardown(info, state);
+    return elapsed;
+}
+
+// Per-op count of event e, or a negative value if it was unavailable
+static double bench_perf_per_op(const bench_result_t *r, int e) {
+    if (!r->perf.valid[e]) {
+        return -1;
+    }
+    return r->ops > 0 ? r->perf.counts[e] / r->ops : 0;
+}
+
+static void bench_print_text_perf(const bench_result_t *r, const bench_thread_perf_t *perf) {
+    printf("  perf:");
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        double v = bench_perf_per_op(r, e);
+        if (e == PERF_CONTEXT_SWITCHES) {
+            // Per run rather than per op; a handful per run is normal
+            if (r->perf.valid[e]) {
+                printf(" %s/run %lld", perf_event_names[e], r->perf.counts[e]);
+            } else {
+                printf(" %s/run n/a", perf_event_names[e]);
+            }
+        } else if (v >= 0) {
+            printf(" %s/op %.2f,", perf_event_names[e], v);
+        } else {
+            printf(" %s/op n/a,", perf_event_names[e]);
+        }
+    }
+    if (r->perf.valid[PERF_CYCLES] && r->perf.valid[PERF_INSTRUCTIONS] &&
+        r->perf.counts[PERF_CYCLES] > 0) {
+        printf(", IPC %.2f",
+               (double)r->perf.counts[PERF_INSTRUCTIONS] / r->perf.counts[PERF_CYCLES]);
+    }
+    printf("\n");
+    for (int i = 0; i < r->num_threads; i++) {
+        printf("  thread %d (cpu %d):", i, perf[i].cpu);
+        for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+            if (perf[i].sample.valid[e]) {
+                printf(" %s %lld", perf_event_names[e], perf[i].sample.counts[e]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+static void bench_print(const bench_config_t *cfg, const char *name, const bench_result_t *r,
+                        const bench_thread_perf_t *perf) {
+    switch (cfg->format) {
+    case BENCH_TEXT:
+        printf("%s: threads %d, %.4f sec (+/- %.4f), %.3g ops/sec (+/- %.1f%%), "
+               "latency p50 %ld ns, p99 %ld ns, p99.9 %ld ns\n",
+               name, r->num_threads, r->mean_sec, r->stddev_sec, r->ops_per_sec,
+               r->ops_per_sec > 0 ? 100 * r->ops_per_sec_stddev / r->ops_per_sec : 0,
+               r->p50_ns, r->p99_ns, r->p999_ns);
+        if (cfg->perf) {
+            bench_print_text_perf(r, perf);
+        }
+        break;
+    case BENCH_CSV:
+        if (bench_header_format != BENCH_CSV) {
+            printf("name,threads,repeats,mean_sec,stddev_sec,ops_per_sec,"
+                   "ops_per_sec_stddev,p50_ns,p99_ns,p999_ns");
+            for (int e = 0; cfg->perf && e < PERF_NUM_EVENTS; e++) {
+                printf(",%s_per_op", perf_event_names[e]);
+            }
+            printf("\n");
+            bench_header_format = BENCH_CSV;
+        }
+        printf("\"%s\",%d,%d,%.6f,%.6f,%.1f,%.1f,%ld,%ld,%ld",
+               name, r->num_threads, cfg->repeats, r->mean_sec, r->stddev_sec,
+               r->ops_per_sec, r->ops_per_sec_stddev, r->p50_ns, r->p99_ns, r->p999_ns);
+        // Unavailable events are left empty
+        for (int e = 0; cfg->perf && e < PERF_NUM_EVENTS; e++) {
+            double v = bench_perf_per_op(r, e);
+            if (v >= 0) {
+                printf(",%.4f", v);
+            } else {
+                printf(",");
+            }
+        }
+        printf("\n");
+        break;
+    case BENCH_JSON:
+        printf("{\"name\": \"%s\", \"threads\": %d, \"repeats\": %d, "
+               "\"mean_sec\": %.6f, \"stddev_sec\": %.6f, \"ops_per_sec\": %.1f, "
+               "\"ops_per_sec_stddev\": %.1f, \"p50_ns\": %ld, \"p99_ns\": %ld, "
+               "\"p999_ns\": %ld",
+               name, r->num_threads, cfg->repeats, r->mean_sec, r->stddev_sec,
+               r->ops_per_sec, r->ops_per_sec_stddev, r->p50_ns, r->p99_ns, r->p999_ns);
+        if (cfg->perf) {
+            printf(", \"perf_per_op\": {");
+            for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+                double v = bench_perf_per_op(r, e);
+                printf(v >= 0 ? "%s\"%s\": %.4f" : "%s\"%s\": null",
+                       e ? ", " : "", perf_event_names[e], v);
+            }
+            printf("}, \"perf_threads\": [");
+            for (int i = 0; i < r->num_threads; i++) {
+                printf("%s{\"thread\": %d, \"cpu\": %d", i ? ", " : "", i, perf[i].cpu);
+                for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+                    if (perf[i].sample.valid[e]) {
+                        printf(", \"%s\": %lld", perf_event_names[e],
+                               perf[i].sample.counts[e]);
+                    } else {
+                        printf(", \"%s\": null", perf_event_names[e]);
+                    }
+                }
+                printf("}");
+            }
+            printf("]");
+        }
+        printf("}\n");
+        break;
+    }
+    fflush(stdout);
+}
+
+// Run bc at every configured thread count. If results is not NULL it
+// receives one entry per thread count.
+static void bench_run(const bench_config_t *cfg, const bench_case_t *bc,
+                      bench_result_t *results) {
+    for (int s = 0; s < cfg->num_thread_counts; s++) {
+        int n = cfg->threads[s];
+        double secs[cfg->repeats];
+        double tput[cfg->repeats];
+        long *lat = NULL;
+        long num_lat = 0;
+        bench_thread_perf_t *perf = cfg->perf ? calloc(n, sizeof(bench_thread_perf_t)) : NULL;
+        perf_sample_t perf_total;
+        double total_ops = 0;
+
+        for (int run = 0; run < cfg->warmup + cfg->repeats; run++) {
+            bench_run_info_t info = {
+                .num_threads = n,
+                .run = run,
+                .warmup = run < cfg->warmup,
+                .last = run == cfg->warmup + cfg->repeats - 1,
+            };
+            long ops = 0;
+            if (info.warmup) {
+                bench_run_once(cfg, bc, &info, &ops, NULL, NULL, perf);
+                continue;
+            }
+            int r = run - cfg->warmup;
+            secs[r] = bench_run_once(cfg, bc, &info, &ops, &lat, &num_lat, perf);
+            tput[r] = secs[r] > 0 ? ops / secs[r] : 0;
+            total_ops += ops;
+            for (int i = 0; perf && i < n; i++) {
+                perf_sample_add(&perf_total, &perf[i].sample, r == 0 && i == 0);
+            }
+        }
+
+        bench_result_t res = { .num_threads = n, .ops = total_ops / cfg->repeats };
+        if (perf) {
+            res.perf = perf_total;
+            for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+                res.perf.counts[e] /= cfg->repeats;
+            }
+        }
+        for (int r = 0; r < cfg->repeats; r++) {
+            res.mean_sec += secs[r] / cfg->repeats;
+            res.ops_per_sec += tput[r] / cfg->repeats;
+        }
+        if (cfg->repeats > 1) {
+            for (int r = 0; r < cfg->repeats; r++) {
+                res.stddev_sec += (secs[r] - res.mean_sec) * (secs[r] - res.mean_sec);
+                res.ops_per_sec_stddev += (tput[r] - res.ops_per_sec) * (tput[r] - res.ops_per_sec);
+            }
+            res.stddev_sec = sqrt(res.stddev_sec / (cfg->repeats - 1));
+            res.ops_per_sec_stddev = sqrt(res.ops_per_sec_stddev / (cfg->repeats - 1));
+        }
+        if (num_lat > 0) {
+            qsort(lat, num_lat, sizeof(long), bench_cmp_long);
+            res.p50_ns = lat[num_lat / 2];
+            res.p99_ns = lat[num_lat * 99 / 100];
+            res.p999_ns = lat[num_lat * 999 / 1000];
+        }
+        free(lat);
+
+        bench_print(cfg, bc->name, &res, perf);
+        free(perf);
+        if (results) {
+            results[s] = res;
+        }
+    }
+}
+
+#endif // __bench_h__
@@ -1,7 +1,8 @@
+#include "bench.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <pthread.h>
-#include <sys/time.h>
 
 typedef struct {
     long value;
@@ -9,9 +10,9 @@ typedef struct {
 } counter_t;
 
 typedef struct {
-    counter_t *counter;
+    counter_t counter;
     int num_increments;
-} thread_arg_t;
+} run_t;
 
 void counter_init(counter_t *c) {
     c->value = 0;
@@ -28,54 +29,61 @@ long counter_get(counter_t *c) {
     return c->value;
 }
 
-void *worker(void *arg) {
-    thread_arg_t *a = (thread_arg_t *)arg;
-    for (int i = 0; i < a->num_increments; i++) {
-        counter_increment(a->counter);
+// === Benchmark ===
+
+void *counter_setup(const bench_run_info_t *info, void *ctx) {
+    run_t *r = bench_alloc_state(sizeof(run_t));
+    counter_init(&r->counter);
+    r->num_increments = *(int *)ctx;
+    return r;
+}
+
+void worker(bench_thread_t *t, void *state) {
+    run_t *r = (run_t *)state;
+    for (int i = 0; i < r->num_increments; i++) {
+        BENCH_OP(t, counter_increment(&r->counter));
+    }
+}
+
+void counter_teardown(const bench_run_info_t *info, void *state) {
+    run_t *r = (run_t *)state;
+    long expected = (long)info->num_threads * r->num_increments;
+    if (counter_get(&r->counter) != expected) {
+        fprintf(stderr, "Counter: %ld, expected %ld\n", counter_get(&r->counter), expected);
     }
-    return NULL;
+    pthread_mutex_destroy(&r->counter.lock);
+    free(r);
 }
 
-double get_time() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec + tv.tv_usec / 1000000.0;
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <num_threads> <num_increments>\n", prog);
+    bench_usage(stderr);
+    exit(1);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <num_threads> <num_increments>\n", argv[0]);
-        return 1;
-    }
-    
-    int num_threads = atoi(argv[1]);
-    int num_increments = atoi(argv[2]);
-    
-    counter_t counter;
-    counter_init(&counter);
-    
-    pthread_t threads[num_threads];
-    thread_arg_t args[num_threads];
-    
-    for (int i = 0; i < num_threads; i++) {
-        args[i].counter = &counter;
-        args[i].num_increments = num_increments;
-    }
-    
-    double start = get_time();
-    
-    for (int i = 0; i < num_threads; i++) {
-        pthread_create(&threads[i], NULL, worker, &args[i]);
+    bench_config_t cfg;
+    bench_config_init(&cfg);
+
+    int opt;
+    while ((opt = getopt(argc, argv, BENCH_OPTSTRING)) != -1) {
+        if (!bench_option(&cfg, opt, optarg)) {
+            usage(argv[0]);
+        }
     }
-    
-    for (int i = 0; i < num_threads; i++) {
-        pthread_join(threads[i], NULL);
+    if (argc - optind != 2 || !bench_parse_threads(&cfg, argv[optind], 1024)) {
+        usage(argv[0]);
     }
-    
-    double end = get_time();
-    
-    printf("Threads: %d, Time: %.4f sec, Counter: %ld\n", 
-           num_threads, end - start, counter_get(&counter));
-    
+    int num_increments = atoi(argv[optind + 1]);
+
+    bench_case_t bc = {
+        .name = "Mutex Counter",
+        .setup = counter_setup,
+        .body = worker,
+        .teardown = counter_teardown,
+        .ctx = &num_increments,
+    };
+    bench_run(&cfg, &bc, NULL);
+
     return 0;
-}
\ No newline at end of file
+}
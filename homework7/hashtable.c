@@ -1,9 +1,19 @@
+#include "bench.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
-#include <sys/time.h>
+#include <unistd.h>
 
-#define BUCKETS 101
+#include "arena.h"
+
+#define BUCKETS 128        // initial/minimum bucket count, also the number of lock stripes
+#define CACHE_LINE 64
+#define GROW_LOAD 2        // grow when the average chain exceeds this
+#define SHRINK_LOAD 4      // shrink when fewer than size / SHRINK_LOAD items
+#define MIGRATE_STEP 4     // non-empty old buckets moved per insert/remove during a resize
+#define MIGRATE_VISITS 32  // cap on old buckets visited per step, empty or not
 
 typedef struct node {
     int key;
@@ -11,190 +21,662 @@ typedef struct node {
     struct node *next;
 } node_t;
 
+// Bucket array; size is always a power of two >= BUCKETS
+typedef struct {
+    node_t **buckets;
+    int size;
+} table_t;
+
 // Global lock hash table
+// While a resize is in progress both tables are live: old buckets below
+// migrate_next have already been moved into cur, the rest are still in old.
 typedef struct {
-    node_t *table[BUCKETS];
+    table_t cur;
+    table_t old;
+    int migrate_next;
+    long count;
+    int resizes;
+    arena_pool_t nodes;
     pthread_mutex_t lock;
 } hash_global_t;
 
 // Per-bucket lock hash table
+// Buckets are guarded by BUCKETS lock stripes (bucket % BUCKETS). Because
+// every size is a power-of-two multiple of BUCKETS, a bucket and all the
+// buckets it splits into or merges with share one stripe, so a migration
+// only needs that stripe. Swapping the tables takes every stripe.
 typedef struct {
-    node_t *table[BUCKETS];
+    table_t cur;
+    table_t old;
+    int migrate_next;
+    int resizes;
+    atomic_long count;
+    atomic_long grow_at;     // count bounds for the current size, so the
+    atomic_long shrink_at;   // common no-resize case needs no lock
+    atomic_int resizing;
+    arena_pool_t nodes;
+    pthread_mutex_t resize_lock;
     pthread_mutex_t locks[BUCKETS];
 } hash_bucket_t;
 
-int hash(int key) {
-    return key % BUCKETS;
+// Lock-free open-addressing hash table.
+// Each slot packs key and value into one 64-bit word so a reader sees
+// both with a single load and writers publish both with a single CAS.
+// Keys must be non-negative, and insert and lookup reject any other: an
+// all-ones word marks an empty slot, which key -1 with value -1 packs to.
+typedef struct {
+    _Atomic uint64_t *slots;
+    uint32_t mask;
+} hash_lockfree_t;
+
+#define SLOT_EMPTY UINT64_MAX
+#define LOCKFREE_MAX_CAPACITY (1 << 30)   // 2^31 slots at 50% load
+
+// Multiplicative hash so consecutive keys spread across buckets and
+// cache lines instead of filling them in order.
+static inline uint32_t hash_mix(int key) {
+    return (uint32_t)key * 2654435761u;
+}
+
+int hash(int key, int size) {
+    return hash_mix(key) & (size - 1);
+}
+
+// === Resizable Bucket Array ===
+
+void table_alloc(table_t *t, int size) {
+    t->buckets = calloc(size, sizeof(node_t *));
+    if (!t->buckets) {
+        perror("calloc");
+        exit(1);
+    }
+    t->size = size;
+}
+
+// New size if count is outside the load-factor band, 0 otherwise
+int table_resize_target(long count, int size) {
+    if (count > (long)GROW_LOAD * size) {
+        return size * 2;
+    }
+    if (size > BUCKETS && count < size / SHRINK_LOAD) {
+        return size / 2;
+    }
+    return 0;
+}
+
+// Move one old bucket's chain into the new table; returns 1 if it was non-empty
+int table_migrate_bucket(table_t *to, table_t *from, int b) {
+    node_t *n = from->buckets[b];
+    if (!n) {
+        return 0;
+    }
+    while (n) {
+        node_t *next = n->next;
+        int nb = hash(n->key, to->size);
+        n->next = to->buckets[nb];
+        to->buckets[nb] = n;
+        n = next;
+    }
+    from->buckets[b] = NULL;
+    return 1;
+}
+
+node_t *chain_find(node_t *n, int key) {
+    while (n) {
+        if (n->key == key) {
+            return n;
+        }
+        n = n->next;
+    }
+    return NULL;
+}
+
+// Unlink and free the first node with key; returns 1 if one was found
+int chain_remove(node_t **link, int key, arena_pool_t *nodes) {
+    while (*link) {
+        node_t *n = *link;
+        if (n->key == key) {
+            *link = n->next;
+            arena_free(nodes, n);
+            return 1;
+        }
+        link = &n->next;
+    }
+    return 0;
 }
 
 // === Global Lock Implementation ===
 
 void hash_global_init(hash_global_t *h) {
-    for (int i = 0; i < BUCKETS; i++) {
-        h->table[i] = NULL;
-    }
+    table_alloc(&h->cur, BUCKETS);
+    h->old.buckets = NULL;
+    h->old.size = 0;
+    h->migrate_next = 0;
+    h->count = 0;
+    h->resizes = 0;
+    arena_pool_init(&h->nodes, sizeof(node_t));
     pthread_mutex_init(&h->lock, NULL);
+    LOCK_PROFILE_NAME(&h->lock, "global lock");
+}
+
+// Nodes live in the table's arena, so the whole table goes in one call
+void hash_global_free(hash_global_t *h) {
+    arena_pool_destroy(&h->nodes);
+    free(h->cur.buckets);
+    free(h->old.buckets);
+    pthread_mutex_destroy(&h->lock);
+}
+
+// Caller holds h->lock. Either advances an in-progress migration by
+// MIGRATE_STEP non-empty buckets (skipping a bounded number of empty
+// ones, so a drained table still finishes shrinking) or starts a new resize if the load factor is out
+// of range, so no single operation pays for a full rehash.
+void hash_global_resize_step(hash_global_t *h) {
+    if (h->old.buckets) {
+        int moved = 0;
+        for (int i = 0; i < MIGRATE_VISITS && moved < MIGRATE_STEP &&
+                        h->migrate_next < h->old.size; i++) {
+            moved += table_migrate_bucket(&h->cur, &h->old, h->migrate_next++);
+        }
+        if (h->migrate_next == h->old.size) {
+            free(h->old.buckets);
+            h->old.buckets = NULL;
+            h->old.size = 0;
+        }
+        return;
+    }
+    
+    int new_size = table_resize_target(h->count, h->cur.size);
+    if (new_size) {
+        h->old = h->cur;
+        table_alloc(&h->cur, new_size);
+        h->migrate_next = 0;
+        h->resizes++;
+    }
 }
 
 void hash_global_insert(hash_global_t *h, int key, int value) {
-    int bucket = hash(key);
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = arena_alloc(&h->nodes);
     n->key = key;
     n->value = value;
     
     pthread_mutex_lock(&h->lock);
-    n->next = h->table[bucket];
-    h->table[bucket] = n;
+    int bucket = hash(key, h->cur.size);
+    n->next = h->cur.buckets[bucket];
+    h->cur.buckets[bucket] = n;
+    h->count++;
+    hash_global_resize_step(h);
     pthread_mutex_unlock(&h->lock);
 }
 
 int hash_global_lookup(hash_global_t *h, int key) {
-    int bucket = hash(key);
-    
     pthread_mutex_lock(&h->lock);
-    node_t *curr = h->table[bucket];
-    while (curr) {
-        if (curr->key == key) {
-            int val = curr->value;
-            pthread_mutex_unlock(&h->lock);
-            return val;
-        }
-        curr = curr->next;
+    node_t *n = chain_find(h->cur.buckets[hash(key, h->cur.size)], key);
+    if (!n && h->old.buckets) {
+        n = chain_find(h->old.buckets[hash(key, h->old.size)], key);
     }
+    int val = n ? n->value : -1;
     pthread_mutex_unlock(&h->lock);
-    return -1;
+    return val;
+}
+
+int hash_global_remove(hash_global_t *h, int key) {
+    pthread_mutex_lock(&h->lock);
+    int found = chain_remove(&h->cur.buckets[hash(key, h->cur.size)], key, &h->nodes);
+    if (!found && h->old.buckets) {
+        found = chain_remove(&h->old.buckets[hash(key, h->old.size)], key, &h->nodes);
+    }
+    if (found) {
+        h->count--;
+        hash_global_resize_step(h);
+    }
+    pthread_mutex_unlock(&h->lock);
+    return found;
 }
 
 // === Per-Bucket Lock Implementation ===
 
+// Publish the load-factor band for cur.size (resize_lock held or init)
+void hash_bucket_set_bounds(hash_bucket_t *h) {
+    long size = h->cur.size;
+    atomic_store_explicit(&h->grow_at, GROW_LOAD * size, memory_order_relaxed);
+    atomic_store_explicit(&h->shrink_at, size > BUCKETS ? size / SHRINK_LOAD : 0,
+                          memory_order_relaxed);
+}
+
 void hash_bucket_init(hash_bucket_t *h) {
+    table_alloc(&h->cur, BUCKETS);
+    h->old.buckets = NULL;
+    h->old.size = 0;
+    h->migrate_next = 0;
+    h->resizes = 0;
+    atomic_init(&h->count, 0);
+    atomic_init(&h->resizing, 0);
+    hash_bucket_set_bounds(h);
+    arena_pool_init(&h->nodes, sizeof(node_t));
+    pthread_mutex_init(&h->resize_lock, NULL);
+    LOCK_PROFILE_NAME(&h->resize_lock, "bucket resize_lock");
     for (int i = 0; i < BUCKETS; i++) {
-        h->table[i] = NULL;
         pthread_mutex_init(&h->locks[i], NULL);
+        LOCK_PROFILE_NAME(&h->locks[i], "bucket stripe %d", i);
+    }
+}
+
+void hash_bucket_free(hash_bucket_t *h) {
+    arena_pool_destroy(&h->nodes);
+    free(h->cur.buckets);
+    free(h->old.buckets);
+    pthread_mutex_destroy(&h->resize_lock);
+    for (int i = 0; i < BUCKETS; i++) {
+        pthread_mutex_destroy(&h->locks[i]);
+    }
+}
+
+static inline pthread_mutex_t *hash_bucket_stripe(hash_bucket_t *h, int key) {
+    return &h->locks[hash(key, BUCKETS)];
+}
+
+void hash_bucket_lock_all(hash_bucket_t *h) {
+    for (int i = 0; i < BUCKETS; i++) {
+        pthread_mutex_lock(&h->locks[i]);
+    }
+}
+
+void hash_bucket_unlock_all(hash_bucket_t *h) {
+    for (int i = BUCKETS - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&h->locks[i]);
+    }
+}
+
+// Called with no stripe held. Only one thread migrates at a time; the
+// others skip ahead rather than wait. Lock order is resize_lock, then
+// stripes, and readers never take resize_lock, so this cannot deadlock.
+void hash_bucket_resize_step(hash_bucket_t *h) {
+    if (!atomic_load_explicit(&h->resizing, memory_order_relaxed)) {
+        long count = atomic_load_explicit(&h->count, memory_order_relaxed);
+        if (count <= atomic_load_explicit(&h->grow_at, memory_order_relaxed) &&
+            count >= atomic_load_explicit(&h->shrink_at, memory_order_relaxed)) {
+            return;
+        }
+    }
+    if (pthread_mutex_trylock(&h->resize_lock) != 0) {
+        return;
+    }
+    
+    if (h->old.buckets) {
+        int moved = 0;
+        for (int i = 0; i < MIGRATE_VISITS && moved < MIGRATE_STEP &&
+                        h->migrate_next < h->old.size; i++) {
+            int b = h->migrate_next++;
+            pthread_mutex_lock(&h->locks[b & (BUCKETS - 1)]);
+            moved += table_migrate_bucket(&h->cur, &h->old, b);
+            pthread_mutex_unlock(&h->locks[b & (BUCKETS - 1)]);
+        }
+        if (h->migrate_next == h->old.size) {
+            hash_bucket_lock_all(h);
+            node_t **done = h->old.buckets;
+            h->old.buckets = NULL;
+            h->old.size = 0;
+            hash_bucket_unlock_all(h);
+            free(done);
+            atomic_store_explicit(&h->resizing, 0, memory_order_relaxed);
+        }
+    } else {
+        long count = atomic_load_explicit(&h->count, memory_order_relaxed);
+        int new_size = table_resize_target(count, h->cur.size);
+        if (new_size) {
+            table_t next;
+            table_alloc(&next, new_size);
+            hash_bucket_lock_all(h);
+            h->old = h->cur;
+            h->cur = next;
+            hash_bucket_unlock_all(h);
+            h->migrate_next = 0;
+            h->resizes++;
+            hash_bucket_set_bounds(h);
+            atomic_store_explicit(&h->resizing, 1, memory_order_relaxed);
+        }
     }
+    
+    pthread_mutex_unlock(&h->resize_lock);
 }
 
 void hash_bucket_insert(hash_bucket_t *h, int key, int value) {
-    int bucket = hash(key);
-    node_t *n = malloc(sizeof(node_t));
+    node_t *n = arena_alloc(&h->nodes);
     n->key = key;
     n->value = value;
     
-    pthread_mutex_lock(&h->locks[bucket]);
-    n->next = h->table[bucket];
-    h->table[bucket] = n;
-    pthread_mutex_unlock(&h->locks[bucket]);
+    pthread_mutex_t *lock = hash_bucket_stripe(h, key);
+    pthread_mutex_lock(lock);
+    int bucket = hash(key, h->cur.size);
+    n->next = h->cur.buckets[bucket];
+    h->cur.buckets[bucket] = n;
+    pthread_mutex_unlock(lock);
+    
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    hash_bucket_resize_step(h);
 }
 
 int hash_bucket_lookup(hash_bucket_t *h, int key) {
-    int bucket = hash(key);
+    pthread_mutex_t *lock = hash_bucket_stripe(h, key);
+    pthread_mutex_lock(lock);
+    node_t *n = chain_find(h->cur.buckets[hash(key, h->cur.size)], key);
+    if (!n && h->old.buckets) {
+        n = chain_find(h->old.buckets[hash(key, h->old.size)], key);
+    }
+    int val = n ? n->value : -1;
+    pthread_mutex_unlock(lock);
+    return val;
+}
+
+int hash_bucket_remove(hash_bucket_t *h, int key) {
+    pthread_mutex_t *lock = hash_bucket_stripe(h, key);
+    pthread_mutex_lock(lock);
+    int found = chain_remove(&h->cur.buckets[hash(key, h->cur.size)], key, &h->nodes);
+    if (!found && h->old.buckets) {
+        found = chain_remove(&h->old.buckets[hash(key, h->old.size)], key, &h->nodes);
+    }
+    pthread_mutex_unlock(lock);
     
-    pthread_mutex_lock(&h->locks[bucket]);
-    node_t *curr = h->table[bucket];
-    while (curr) {
-        if (curr->key == key) {
-            int val = curr->value;
-            pthread_mutex_unlock(&h->locks[bucket]);
-            return val;
+    if (found) {
+        atomic_fetch_sub_explicit(&h->count, 1, memory_order_relaxed);
+        hash_bucket_resize_step(h);
+    }
+    return found;
+}
+
+// === Lock-Free Open-Addressing Implementation ===
+
+static inline uint64_t slot_pack(int key, int value) {
+    return ((uint64_t)(uint32_t)key << 32) | (uint32_t)value;
+}
+
+static inline int slot_key(uint64_t s) {
+    return (int)(s >> 32);
+}
+
+static inline int slot_value(uint64_t s) {
+    return (int)(uint32_t)s;
+}
+
+void hash_lockfree_init(hash_lockfree_t *h, int capacity) {
+    // Past this, doubling the size would wrap to 0 and never stop
+    if (capacity < 0 || capacity > LOCKFREE_MAX_CAPACITY) {
+        fprintf(stderr, "hash_lockfree_init: capacity %d out of range [0, %d]\n",
+                capacity, LOCKFREE_MAX_CAPACITY);
+        exit(1);
+    }
+    // Keep the load factor at or below 50% so probe sequences stay short
+    uint32_t size = CACHE_LINE / sizeof(uint64_t);
+    while (size < 2 * (uint32_t)capacity) {
+        size <<= 1;
+    }
+    h->slots = aligned_alloc(CACHE_LINE, size * sizeof(uint64_t));
+    if (!h->slots) {
+        perror("aligned_alloc");
+        exit(1);
+    }
+    for (uint32_t i = 0; i < size; i++) {
+        atomic_init(&h->slots[i], SLOT_EMPTY);
+    }
+    h->mask = size - 1;
+}
+
+void hash_lockfree_free(hash_lockfree_t *h) {
+    free((void *)h->slots);
+    h->slots = NULL;
+}
+
+// Linear probing: claim the first empty slot with a CAS, or replace the
+// value in place if the key is already present. Returns -1 when full or
+// the key is negative.
+int hash_lockfree_insert(hash_lockfree_t *h, int key, int value) {
+    if (key < 0) {
+        return -1;
+    }
+    uint64_t want = slot_pack(key, value);
+    uint32_t i = hash_mix(key) & h->mask;
+
+    for (uint32_t probes = 0; probes <= h->mask; probes++) {
+        uint64_t cur = atomic_load_explicit(&h->slots[i], memory_order_acquire);
+        while (cur == SLOT_EMPTY || slot_key(cur) == key) {
+            if (atomic_compare_exchange_weak_explicit(&h->slots[i], &cur, want,
+                                                      memory_order_release,
+                                                      memory_order_acquire)) {
+                return 0;
+            }
+            // Lost the race: cur now holds the winner, re-check it
+        }
+        i = (i + 1) & h->mask;
+    }
+    return -1;
+}
+
+int hash_lockfree_lookup(hash_lockfree_t *h, int key) {
+    if (key < 0) {
+        return -1;
+    }
+    uint32_t i = hash_mix(key) & h->mask;
+
+    for (uint32_t probes = 0; probes <= h->mask; probes++) {
+        uint64_t cur = atomic_load_explicit(&h->slots[i], memory_order_acquire);
+        if (cur == SLOT_EMPTY) {
+            return -1;
+        }
+        if (slot_key(cur) == key) {
+            return slot_value(cur);
         }
-        curr = curr->next;
+        i = (i + 1) & h->mask;
     }
-    pthread_mutex_unlock(&h->locks[bucket]);
     return -1;
 }
 
 // === Benchmark ===
 
+typedef enum {
+    MODE_GLOBAL,
+    MODE_BUCKET,
+    MODE_LOCKFREE,
+} hash_mode_t;
+
+static const char *mode_names[] = {
+    [MODE_GLOBAL]   = "Global Lock",
+    [MODE_BUCKET]   = "Per-Bucket Lock",
+    [MODE_LOCKFREE] = "Lock-Free",
+};
+
 typedef struct {
-    void *hash;
-    int *keys;
+    hash_mode_t mode;
+    int num_items;
     int num_ops;
-    int use_bucket;
-} arg_t;
+    bench_format_t format;
+} case_t;
+
+// State of one run: the populated table and every thread's key stream
+typedef struct {
+    const case_t *c;
+    hash_global_t hg;
+    hash_bucket_t hb;
+    hash_lockfree_t hl;
+    void *hash;
+    int **keys;
+    int num_threads;
+} run_t;
 
-void *worker(void *arg) {
-    arg_t *a = (arg_t *)arg;
+void worker(bench_thread_t *t, void *state) {
+    run_t *run = (run_t *)state;
+    int *keys = run->keys[t->id];
     
-    for (int i = 0; i < a->num_ops; i++) {
-        if (a->use_bucket) {
-            hash_bucket_lookup((hash_bucket_t *)a->hash, a->keys[i]);
-        } else {
-            hash_global_lookup((hash_global_t *)a->hash, a->keys[i]);
+    for (int i = 0; i < run->c->num_ops; i++) {
+        switch (run->c->mode) {
+        case MODE_GLOBAL:
+            BENCH_OP(t, hash_global_lookup((hash_global_t *)run->hash, keys[i]));
+            break;
+        case MODE_BUCKET:
+            BENCH_OP(t, hash_bucket_lookup((hash_bucket_t *)run->hash, keys[i]));
+            break;
+        case MODE_LOCKFREE:
+            BENCH_OP(t, hash_lockfree_lookup((hash_lockfree_t *)run->hash, keys[i]));
+            break;
         }
     }
-    return NULL;
 }
 
-double get_time() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec + tv.tv_usec / 1000000.0;
+// Populate the table, timing every insert so the cost of resizes shows
+// up in the tail rather than being averaged away
+void populate(hash_mode_t mode, void *h, int num_items, int report) {
+    long *lat = malloc(num_items * sizeof(long));
+    
+    for (int i = 0; i < num_items; i++) {
+        long t0 = bench_now_ns();
+        switch (mode) {
+        case MODE_GLOBAL:
+            hash_global_insert((hash_global_t *)h, i, i * 10);
+            break;
+        case MODE_BUCKET:
+            hash_bucket_insert((hash_bucket_t *)h, i, i * 10);
+            break;
+        case MODE_LOCKFREE:
+            hash_lockfree_insert((hash_lockfree_t *)h, i, i * 10);
+            break;
+        }
+        lat[i] = bench_now_ns() - t0;
+    }
+    
+    if (report) {
+        qsort(lat, num_items, sizeof(long), bench_cmp_long);
+        printf("%s: insert p50 %ld ns, p99 %ld ns, max %ld ns\n", mode_names[mode],
+               lat[num_items / 2], lat[(long)num_items * 99 / 100], lat[num_items - 1]);
+    }
+    free(lat);
 }
 
-void run_test(int use_bucket, int num_threads, int num_items, int num_ops) {
-    hash_global_t hg;
-    hash_bucket_t hb;
+void *hash_setup(const bench_run_info_t *info, void *ctx) {
+    case_t *c = (case_t *)ctx;
+    run_t *run = bench_alloc_state(sizeof(run_t));
+    run->c = c;
+    run->num_threads = info->num_threads;
+    run->hash = NULL;
     
     // Initialize
-    if (use_bucket) {
-        hash_bucket_init(&hb);
-        for (int i = 0; i < num_items; i++) {
-            hash_bucket_insert(&hb, i, i * 10);
-        }
-    } else {
-        hash_global_init(&hg);
-        for (int i = 0; i < num_items; i++) {
-            hash_global_insert(&hg, i, i * 10);
-        }
+    switch (c->mode) {
+    case MODE_GLOBAL:
+        hash_global_init(&run->hg);
+        run->hash = &run->hg;
+        break;
+    case MODE_BUCKET:
+        hash_bucket_init(&run->hb);
+        run->hash = &run->hb;
+        break;
+    case MODE_LOCKFREE:
+        // Open addressing is sized up front and does not resize
+        hash_lockfree_init(&run->hl, c->num_items);
+        run->hash = &run->hl;
+        break;
     }
+    populate(c->mode, run->hash, c->num_items, info->last && c->format == BENCH_TEXT);
     
-    // Setup threads
-    pthread_t threads[num_threads];
-    arg_t args[num_threads];
+    // Same seed for every mode so all tables see identical key streams
+    srand(1);
     
-    for (int i = 0; i < num_threads; i++) {
-        args[i].hash = use_bucket ? (void *)&hb : (void *)&hg;
-        args[i].num_ops = num_ops;
-        args[i].use_bucket = use_bucket;
-        args[i].keys = malloc(num_ops * sizeof(int));
-        for (int j = 0; j < num_ops; j++) {
-            args[i].keys[j] = rand() % num_items;
+    run->keys = malloc(info->num_threads * sizeof(int *));
+    for (int i = 0; i < info->num_threads; i++) {
+        run->keys[i] = malloc(c->num_ops * sizeof(int));
+        for (int j = 0; j < c->num_ops; j++) {
+            run->keys[i][j] = rand() % c->num_items;
         }
     }
+    return run;
+}
+
+void hash_teardown(const bench_run_info_t *info, void *state) {
+    run_t *run = (run_t *)state;
+    const case_t *c = run->c;
+    int report = info->last && c->format == BENCH_TEXT;
     
-    // Run
-    double start = get_time();
-    for (int i = 0; i < num_threads; i++) {
-        pthread_create(&threads[i], NULL, worker, &args[i]);
-    }
-    for (int i = 0; i < num_threads; i++) {
-        pthread_join(threads[i], NULL);
+    // Drain the chained tables to exercise shrinking
+    if (c->mode == MODE_GLOBAL) {
+        int peak = run->hg.cur.size;
+        for (int i = 0; i < c->num_items; i++) {
+            hash_global_remove(&run->hg, i);
+        }
+        if (report) {
+            printf("%s: %d resizes, peak %d buckets, %d after drain\n",
+                   mode_names[c->mode], run->hg.resizes, peak, run->hg.cur.size);
+        }
+    } else if (c->mode == MODE_BUCKET) {
+        int peak = run->hb.cur.size;
+        for (int i = 0; i < c->num_items; i++) {
+            hash_bucket_remove(&run->hb, i);
+        }
+        if (report) {
+            printf("%s: %d resizes, peak %d buckets, %d after drain\n",
+                   mode_names[c->mode], run->hb.resizes, peak, run->hb.cur.size);
+        }
     }
-    double time = get_time() - start;
-    
-    printf("%s: %.4f sec\n", 
-           use_bucket ? "Per-Bucket Lock" : "Global Lock    ", time);
     
     // Cleanup
-    for (int i = 0; i < num_threads; i++) {
-        free(args[i].keys);
+    for (int i = 0; i < run->num_threads; i++) {
+        free(run->keys[i]);
+    }
+    free(run->keys);
+    switch (c->mode) {
+    case MODE_GLOBAL:
+        hash_global_free(&run->hg);
+        break;
+    case MODE_BUCKET:
+        hash_bucket_free(&run->hb);
+        break;
+    case MODE_LOCKFREE:
+        hash_lockfree_free(&run->hl);
+        break;
     }
+    free(run);
+}
+
+void run_test(const bench_config_t *cfg, hash_mode_t mode, int num_items, int num_ops) {
+    case_t c = { .mode = mode, .num_items = num_items, .num_ops = num_ops,
+                 .format = cfg->format };
+    bench_case_t bc = {
+        .name = mode_names[mode],
+        .setup = hash_setup,
+        .body = worker,
+        .teardown = hash_teardown,
+        .ctx = &c,
+    };
+    bench_run(cfg, &bc, NULL);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <threads> <items> <lookups>\n", prog);
+    bench_usage(stderr);
+    exit(1);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <threads> <items> <lookups>\n", argv[0]);
-        return 1;
+    bench_config_t cfg;
+    bench_config_init(&cfg);
+    
+    int opt;
+    while ((opt = getopt(argc, argv, BENCH_OPTSTRING)) != -1) {
+        if (!bench_option(&cfg, opt, optarg)) {
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 3 || !bench_parse_threads(&cfg, argv[optind], 1024)) {
+        usage(argv[0]);
     }
     
-    int threads = atoi(argv[1]);
-    int items = atoi(argv[2]);
-    int ops = atoi(argv[3]);
+    int items = atoi(argv[optind + 1]);
+    int ops = atoi(argv[optind + 2]);
     
-    printf("Threads: %d, Items: %d, Lookups: %d, Buckets: %d\n", 
-           threads, items, ops, BUCKETS);
-    run_test(0, threads, items, ops);
-    run_test(1, threads, items, ops);
+    if (cfg.format == BENCH_TEXT) {
+        printf("Threads: %s, Items: %d, Lookups: %d, Initial Buckets: %d\n",
+               argv[optind], items, ops, BUCKETS);
+    }
+    run_test(&cfg, MODE_GLOBAL, items, ops);
+    run_test(&cfg, MODE_BUCKET, items, ops);
+    run_test(&cfg, MODE_LOCKFREE, items, ops);
     
     return 0;
-}
\ No newline at end of file
+}
@@ -1,7 +1,16 @@
+#include "bench.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
-#include <sys/time.h>
+#include <unistd.h>
+
+#include "arena.h"
+
+#define EBR_MAX_THREADS 64
+#define EBR_OFFLINE UINT64_MAX   // slot value for a thread holding no references
+#define EBR_BATCH 64             // retired nodes to collect before reclaiming
 
 typedef struct node {
     int key;
@@ -9,16 +18,56 @@ typedef struct node {
     pthread_mutex_t lock;
 } node_t;
 
+// Per-thread epoch announcement, one cache line each
+typedef struct {
+    _Atomic uint64_t epoch;
+} __attribute__((aligned(64))) ebr_slot_t;
+
+typedef struct {
+    node_t *node;
+    uint64_t epoch;
+} ebr_retired_t;
+
+// Epoch-based reclamation state for the RCU list
+typedef struct {
+    _Atomic uint64_t epoch;
+    ebr_slot_t slots[EBR_MAX_THREADS];
+    ebr_retired_t *limbo;    // guarded by the list's writer lock
+    int limbo_len;
+    int limbo_cap;
+} ebr_t;
+
 typedef struct {
     node_t *head;
     pthread_mutex_t lock;
+    arena_pool_t nodes;
+    ebr_t ebr;
 } list_t;
 
+node_t *node_alloc(list_t *list, int key) {
+    node_t *n = arena_alloc(&list->nodes);
+    n->key = key;
+    n->next = NULL;
+    pthread_mutex_init(&n->lock, NULL);
+    return n;
+}
+
+// Releases every node at once. Node mutexes are default-initialized and
+// unlocked, so they hold no resources that need a per-node destroy.
+void list_free(list_t *list) {
+    arena_pool_destroy(&list->nodes);
+    free(list->ebr.limbo);
+    list->ebr.limbo = NULL;
+    list->head = NULL;
+}
+
 // === Standard List (one global lock) ===
 
 void list_init(list_t *list) {
     list->head = NULL;
     pthread_mutex_init(&list->lock, NULL);
+    arena_pool_init(&list->nodes, sizeof(node_t));
+    list->ebr.limbo = NULL;
 }
 
 int list_lookup(list_t *list, int key) {
@@ -35,124 +84,471 @@ int list_lookup(list_t *list, int key) {
     return 0;
 }
 
+// The list is kept sorted by key with no duplicates. Returns 1 if the
+// key was added, 0 if it was already present.
+int list_insert(list_t *list, int key) {
+    node_t *n = node_alloc(list, key);
+
+    pthread_mutex_lock(&list->lock);
+    node_t **link = &list->head;
+    while (*link && (*link)->key < key) {
+        link = &(*link)->next;
+    }
+    if (*link && (*link)->key == key) {
+        pthread_mutex_unlock(&list->lock);
+        arena_free(&list->nodes, n);
+        return 0;
+    }
+    n->next = *link;
+    *link = n;
+    pthread_mutex_unlock(&list->lock);
+    return 1;
+}
+
+int list_delete(list_t *list, int key) {
+    pthread_mutex_lock(&list->lock);
+    node_t **link = &list->head;
+    while (*link && (*link)->key < key) {
+        link = &(*link)->next;
+    }
+    node_t *n = *link;
+    if (!n || n->key != key) {
+        pthread_mutex_unlock(&list->lock);
+        return 0;
+    }
+    *link = n->next;
+    pthread_mutex_unlock(&list->lock);
+    arena_free(&list->nodes, n);
+    return 1;
+}
+
 // === Hand-Over-Hand List (per-node locks) ===
 
 void hoh_init(list_t *list) {
-    list->head = malloc(sizeof(node_t));
-    list->head->key = -1;
-    list->head->next = NULL;
-    pthread_mutex_init(&list->head->lock, NULL);
+    arena_pool_init(&list->nodes, sizeof(node_t));
+    list->head = node_alloc(list, -1);
+    list->ebr.limbo = NULL;
 }
 
 int hoh_lookup(list_t *list, int key) {
     pthread_mutex_lock(&list->head->lock);
     node_t *curr = list->head;
-    
+
     while (curr->next) {
-        pthread_mutex_lock(&curr->next->lock);
+        // Read next while curr is still locked: once curr is released a
+        // delete may unlink and free it
+        node_t *next = curr->next;
+        pthread_mutex_lock(&next->lock);
         pthread_mutex_unlock(&curr->lock);
-        curr = curr->next;
-        
+        curr = next;
+
         if (curr->key == key) {
             pthread_mutex_unlock(&curr->lock);
             return 1;
         }
     }
-    
+
     pthread_mutex_unlock(&curr->lock);
     return 0;
 }
 
-// === Benchmark ===
+// Walk hand-over-hand to the first node with key >= key. Returns with
+// *prev and *curr (if not NULL) both locked. A node can only be unlinked
+// by a thread holding its predecessor's lock, so nobody else can be
+// waiting on *curr once we hold *prev.
+void hoh_find(list_t *list, int key, node_t **prev, node_t **curr) {
+    node_t *p = list->head;
+    pthread_mutex_lock(&p->lock);
+    node_t *c = p->next;
 
-typedef struct {
-    list_t *list;
-    int *keys;
-    int num_ops;
-    int use_hoh;
-} arg_t;
-
-void *worker(void *arg) {
-    arg_t *a = (arg_t *)arg;
-    for (int i = 0; i < a->num_ops; i++) {
-        if (a->use_hoh) {
-            hoh_lookup(a->list, a->keys[i]);
+    while (c) {
+        pthread_mutex_lock(&c->lock);
+        if (c->key >= key) {
+            break;
+        }
+        pthread_mutex_unlock(&p->lock);
+        p = c;
+        c = c->next;
+    }
+
+    *prev = p;
+    *curr = c;
+}
+
+int hoh_insert(list_t *list, int key) {
+    node_t *n = node_alloc(list, key);
+    node_t *prev, *curr;
+    hoh_find(list, key, &prev, &curr);
+
+    int added = !curr || curr->key != key;
+    if (added) {
+        n->next = curr;
+        prev->next = n;
+    }
+
+    if (curr) {
+        pthread_mutex_unlock(&curr->lock);
+    }
+    pthread_mutex_unlock(&prev->lock);
+    if (!added) {
+        arena_free(&list->nodes, n);
+    }
+    return added;
+}
+
+int hoh_delete(list_t *list, int key) {
+    node_t *prev, *curr;
+    hoh_find(list, key, &prev, &curr);
+
+    if (!curr || curr->key != key) {
+        if (curr) {
+            pthread_mutex_unlock(&curr->lock);
+        }
+        pthread_mutex_unlock(&prev->lock);
+        return 0;
+    }
+
+    prev->next = curr->next;
+    pthread_mutex_unlock(&curr->lock);
+    pthread_mutex_unlock(&prev->lock);
+    arena_free(&list->nodes, curr);
+    return 1;
+}
+
+// === RCU List (lock-free readers, epoch-based reclamation) ===
+//
+// Readers walk the list with plain acquire loads: no locks and no
+// read-modify-write atomics. Writers serialize on list->lock, publish
+// with a single release store of a next pointer, and retire unlinked
+// nodes instead of freeing them. Reclamation is quiescent-state based:
+// each reader thread announces the current global epoch between
+// operations, and a node retired at epoch e is freed once every online
+// thread has announced an epoch > e, i.e. has finished any traversal
+// that could still see it.
+
+void rcu_init(list_t *list) {
+    list_init(list);
+    atomic_init(&list->ebr.epoch, 1);
+    for (int i = 0; i < EBR_MAX_THREADS; i++) {
+        atomic_init(&list->ebr.slots[i].epoch, EBR_OFFLINE);
+    }
+    list->ebr.limbo_len = 0;
+    list->ebr.limbo_cap = 0;
+}
+
+// Must be called by a thread before its first operation. Announcing is a
+// store followed by the traversal's loads, and reclamation is an unlink
+// store followed by loads of the slots: store buffering, which only
+// seq_cst fences on both sides rule out. With the fence here and the one
+// in ebr_reclaim, a new reader is either seen by the scan or cannot reach
+// already-unlinked nodes.
+void ebr_online(ebr_t *e, int tid) {
+    uint64_t now = atomic_load(&e->epoch);
+    atomic_store(&e->slots[tid].epoch, now);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+// Called between operations: announces that this thread holds no
+// references to nodes retired before the current epoch. The acquire load
+// makes the unlinks behind that epoch visible to the next traversal.
+static inline void ebr_quiescent(ebr_t *e, int tid) {
+    uint64_t now = atomic_load_explicit(&e->epoch, memory_order_acquire);
+    atomic_store_explicit(&e->slots[tid].epoch, now, memory_order_release);
+}
+
+void ebr_offline(ebr_t *e, int tid) {
+    atomic_store_explicit(&e->slots[tid].epoch, EBR_OFFLINE, memory_order_release);
+}
+
+// Caller holds the writer lock
+void ebr_reclaim(list_t *list) {
+    ebr_t *e = &list->ebr;
+    uint64_t min = EBR_OFFLINE;
+    // Pairs with the fence in ebr_online
+    atomic_thread_fence(memory_order_seq_cst);
+    for (int i = 0; i < EBR_MAX_THREADS; i++) {
+        uint64_t s = atomic_load_explicit(&e->slots[i].epoch, memory_order_acquire);
+        if (s < min) {
+            min = s;
+        }
+    }
+
+    int kept = 0;
+    for (int i = 0; i < e->limbo_len; i++) {
+        if (e->limbo[i].epoch < min) {
+            arena_free(&list->nodes, e->limbo[i].node);
         } else {
-            list_lookup(a->list, a->keys[i]);
+            e->limbo[kept++] = e->limbo[i];
         }
     }
-    return NULL;
+    e->limbo_len = kept;
 }
 
-double get_time() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec + tv.tv_usec / 1000000.0;
+// Caller holds the writer lock and has already unlinked n
+void ebr_retire(list_t *list, node_t *n) {
+    ebr_t *e = &list->ebr;
+    if (e->limbo_len == e->limbo_cap) {
+        e->limbo_cap = e->limbo_cap ? e->limbo_cap * 2 : EBR_BATCH;
+        e->limbo = realloc(e->limbo, e->limbo_cap * sizeof(ebr_retired_t));
+        if (!e->limbo) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    // Advancing the epoch after the unlink means any reader announcing
+    // the new value started its next traversal without this node.
+    e->limbo[e->limbo_len].node = n;
+    e->limbo[e->limbo_len].epoch = atomic_fetch_add(&e->epoch, 1);
+    e->limbo_len++;
+
+    if (e->limbo_len >= EBR_BATCH) {
+        ebr_reclaim(list);
+    }
+}
+
+int rcu_lookup(list_t *list, int key) {
+    node_t *curr = __atomic_load_n(&list->head, __ATOMIC_ACQUIRE);
+    while (curr) {
+        if (curr->key == key) {
+            return 1;
+        }
+        curr = __atomic_load_n(&curr->next, __ATOMIC_ACQUIRE);
+    }
+    return 0;
+}
+
+int rcu_insert(list_t *list, int key) {
+    node_t *n = node_alloc(list, key);
+
+    pthread_mutex_lock(&list->lock);
+    node_t **link = &list->head;
+    while (*link && (*link)->key < key) {
+        link = &(*link)->next;
+    }
+    if (*link && (*link)->key == key) {
+        pthread_mutex_unlock(&list->lock);
+        arena_free(&list->nodes, n);
+        return 0;
+    }
+    // n is fully initialized before the release store makes it reachable
+    n->next = *link;
+    __atomic_store_n(link, n, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&list->lock);
+    return 1;
 }
 
-void run_test(int use_hoh, int num_threads, int list_size, int num_ops) {
+int rcu_delete(list_t *list, int key) {
+    pthread_mutex_lock(&list->lock);
+    node_t **link = &list->head;
+    while (*link && (*link)->key < key) {
+        link = &(*link)->next;
+    }
+    node_t *n = *link;
+    if (!n || n->key != key) {
+        pthread_mutex_unlock(&list->lock);
+        return 0;
+    }
+    // Readers already on n still follow n->next back into the list
+    __atomic_store_n(link, n->next, __ATOMIC_RELEASE);
+    ebr_retire(list, n);
+    pthread_mutex_unlock(&list->lock);
+    return 1;
+}
+
+// === Benchmark ===
+
+typedef enum {
+    MODE_STANDARD,
+    MODE_HOH,
+    MODE_RCU,
+} list_mode_t;
+
+static const char *mode_names[] = {
+    [MODE_STANDARD] = "Standard",
+    [MODE_HOH]      = "Hand-Over-Hand",
+    [MODE_RCU]      = "RCU",
+};
+
+typedef enum {
+    OP_LOOKUP,
+    OP_INSERT,
+    OP_DELETE,
+} op_t;
+
+typedef struct {
+    list_mode_t mode;
+    int list_size;
+    int num_ops;
+    int write_pct;
+} case_t;
+
+// State of one run: the list and every thread's op stream
+typedef struct {
+    const case_t *c;
     list_t list;
-    
-    // Initialize and populate
-    if (use_hoh) {
-        hoh_init(&list);
-    } else {
-        list_init(&list);
-    }
-    
-    for (int i = list_size - 1; i >= 0; i--) {
-        node_t *n = malloc(sizeof(node_t));
-        n->key = i;
-        pthread_mutex_init(&n->lock, NULL);
-        n->next = list.head;
-        list.head = n;
-    }
-    
-    // Setup threads
-    pthread_t threads[num_threads];
-    arg_t args[num_threads];
-    
-    for (int i = 0; i < num_threads; i++) {
-        args[i].list = &list;
-        args[i].num_ops = num_ops;
-        args[i].use_hoh = use_hoh;
-        args[i].keys = malloc(num_ops * sizeof(int));
-        for (int j = 0; j < num_ops; j++) {
-            args[i].keys[j] = rand() % list_size;
+    int **keys;
+    char **ops;
+    int num_threads;
+} run_t;
+
+void worker(bench_thread_t *t, void *state) {
+    run_t *run = (run_t *)state;
+    list_t *list = &run->list;
+    list_mode_t mode = run->c->mode;
+    int *keys = run->keys[t->id];
+    char *ops = run->ops[t->id];
+
+    if (mode == MODE_RCU) {
+        ebr_online(&list->ebr, t->id);
+    }
+
+    for (int i = 0; i < run->c->num_ops; i++) {
+        int key = keys[i];
+        switch (mode) {
+        case MODE_STANDARD:
+            switch (ops[i]) {
+            case OP_LOOKUP: BENCH_OP(t, list_lookup(list, key)); break;
+            case OP_INSERT: BENCH_OP(t, list_insert(list, key)); break;
+            case OP_DELETE: BENCH_OP(t, list_delete(list, key)); break;
+            }
+            break;
+        case MODE_HOH:
+            switch (ops[i]) {
+            case OP_LOOKUP: BENCH_OP(t, hoh_lookup(list, key)); break;
+            case OP_INSERT: BENCH_OP(t, hoh_insert(list, key)); break;
+            case OP_DELETE: BENCH_OP(t, hoh_delete(list, key)); break;
+            }
+            break;
+        case MODE_RCU:
+            switch (ops[i]) {
+            case OP_LOOKUP: BENCH_OP(t, rcu_lookup(list, key)); break;
+            case OP_INSERT: BENCH_OP(t, rcu_insert(list, key)); break;
+            case OP_DELETE: BENCH_OP(t, rcu_delete(list, key)); break;
+            }
+            ebr_quiescent(&list->ebr, t->id);
+            break;
         }
     }
-    
-    // Run
-    double start = get_time();
-    for (int i = 0; i < num_threads; i++) {
-        pthread_create(&threads[i], NULL, worker, &args[i]);
+
+    if (mode == MODE_RCU) {
+        ebr_offline(&list->ebr, t->id);
     }
-    for (int i = 0; i < num_threads; i++) {
-        pthread_join(threads[i], NULL);
+}
+
+void *list_setup(const bench_run_info_t *info, void *ctx) {
+    case_t *c = (case_t *)ctx;
+    int num_threads = info->num_threads;
+    run_t *run = bench_alloc_state(sizeof(run_t));
+    run->c = c;
+    run->num_threads = num_threads;
+    list_t *list = &run->list;
+
+    // Initialize and populate
+    switch (c->mode) {
+    case MODE_STANDARD:
+        list_init(list);
+        break;
+    case MODE_HOH:
+        hoh_init(list);
+        break;
+    case MODE_RCU:
+        rcu_init(list);
+        break;
+    }
+
+    // Append in key order so nodes are laid out in traversal order
+    // (after the sentinel, for hand-over-hand)
+    node_t **tail = (c->mode == MODE_HOH) ? &list->head->next : &list->head;
+    for (int i = 0; i < c->list_size; i++) {
+        *tail = node_alloc(list, i);
+        tail = &(*tail)->next;
     }
-    double time = get_time() - start;
-    
-    printf("%s: %.4f sec\n", use_hoh ? "Hand-Over-Hand" : "Standard     ", time);
-    
-    // Cleanup
+
+    // Same seed for every mode so all lists see identical op streams.
+    // Writes draw keys from twice the initial range and split evenly
+    // between insert and delete, so the list size stays near list_size.
+    srand(1);
+
+    run->keys = malloc(num_threads * sizeof(int *));
+    run->ops = malloc(num_threads * sizeof(char *));
     for (int i = 0; i < num_threads; i++) {
-        free(args[i].keys);
+        run->keys[i] = malloc(c->num_ops * sizeof(int));
+        run->ops[i] = malloc(c->num_ops);
+        for (int j = 0; j < c->num_ops; j++) {
+            if (rand() % 100 < c->write_pct) {
+                run->ops[i][j] = (rand() & 1) ? OP_INSERT : OP_DELETE;
+                run->keys[i][j] = rand() % (2 * c->list_size);
+            } else {
+                run->ops[i][j] = OP_LOOKUP;
+                run->keys[i][j] = rand() % c->list_size;
+            }
+        }
     }
+    return run;
+}
+
+void list_teardown(const bench_run_info_t *info, void *state) {
+    run_t *run = (run_t *)state;
+    for (int i = 0; i < run->num_threads; i++) {
+        free(run->keys[i]);
+        free(run->ops[i]);
+    }
+    free(run->keys);
+    free(run->ops);
+    list_free(&run->list);
+    free(run);
+}
+
+void run_test(const bench_config_t *cfg, list_mode_t mode, int list_size, int num_ops,
+              int write_pct) {
+    case_t c = { .mode = mode, .list_size = list_size, .num_ops = num_ops,
+                 .write_pct = write_pct };
+    bench_case_t bc = {
+        .name = mode_names[mode],
+        .setup = list_setup,
+        .body = worker,
+        .teardown = list_teardown,
+        .ctx = &c,
+    };
+    bench_run(cfg, &bc, NULL);
+}
+
+void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <threads> <list_size> <ops> [write_pct]\n", prog);
+    bench_usage(stderr);
+    exit(1);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <threads> <list_size> <lookups>\n", argv[0]);
+    bench_config_t cfg;
+    bench_config_init(&cfg);
+
+    int opt;
+    while ((opt = getopt(argc, argv, BENCH_OPTSTRING)) != -1) {
+        if (!bench_option(&cfg, opt, optarg)) {
+            usage(argv[0]);
+        }
+    }
+    int nargs = argc - optind;
+    if (nargs != 3 && nargs != 4) {
+        usage(argv[0]);
+    }
+    if (!bench_parse_threads(&cfg, argv[optind], EBR_MAX_THREADS)) {
+        fprintf(stderr, "Threads must be between 1 and %d\n", EBR_MAX_THREADS);
         return 1;
     }
-    
-    int threads = atoi(argv[1]);
-    int size = atoi(argv[2]);
-    int ops = atoi(argv[3]);
-    
-    printf("Threads: %d, List: %d, Lookups: %d\n", threads, size, ops);
-    run_test(0, threads, size, ops);
-    run_test(1, threads, size, ops);
-    
+
+    int size = atoi(argv[optind + 1]);
+    int ops = atoi(argv[optind + 2]);
+    int write_pct = (nargs == 4) ? atoi(argv[optind + 3]) : 0;
+
+    if (cfg.format == BENCH_TEXT) {
+        printf("Threads: %s, List: %d, Ops: %d, Writes: %d%%\n", argv[optind], size, ops,
+               write_pct);
+    }
+    run_test(&cfg, MODE_STANDARD, size, ops, write_pct);
+    run_test(&cfg, MODE_HOH, size, ops, write_pct);
+    run_test(&cfg, MODE_RCU, size, ops, write_pct);
+
     return 0;
-}
\ No newline at end of file
+}
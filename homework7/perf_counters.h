@@ -0,0 +1,154 @@
+#ifndef __perf_counters_h__
+#define __perf_counters_h__
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Per-thread hardware counters via perf_event_open(2).
+//
+// perf_counters_open() attaches one counter per event to the calling
+// thread, disabled; start/stop bracket the region to measure. Events the
+// machine or its perf_event_paranoid setting does not allow are left
+// closed and reported as unavailable rather than failing the run (VMs
+// often expose no hardware PMU at all). Counts are scaled up if the
+// kernel had to multiplex counters.
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_CONTEXT_SWITCHES,
+    PERF_NUM_EVENTS,
+} perf_event_id_t;
+
+static const char *perf_event_names[] = {
+    [PERF_CYCLES]           = "cycles",
+    [PERF_INSTRUCTIONS]     = "instructions",
+    [PERF_LLC_MISSES]       = "llc_misses",
+    [PERF_DTLB_MISSES]      = "dtlb_misses",
+    [PERF_CONTEXT_SWITCHES] = "context_switches",
+};
+
+typedef struct {
+    int fds[PERF_NUM_EVENTS];
+} perf_counters_t;
+
+typedef struct {
+    long long counts[PERF_NUM_EVENTS];
+    int valid[PERF_NUM_EVENTS];
+} perf_sample_t;
+
+static inline int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu,
+                                  int group_fd, unsigned long flags) {
+    return syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+static inline void perf_event_attr_for(perf_event_id_t e, struct perf_event_attr *attr) {
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->disabled = 1;
+    attr->exclude_hv = 1;
+    attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    switch (e) {
+    case PERF_CYCLES:
+        attr->type = PERF_TYPE_HARDWARE;
+        attr->config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PERF_INSTRUCTIONS:
+        attr->type = PERF_TYPE_HARDWARE;
+        attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PERF_LLC_MISSES:
+        attr->type = PERF_TYPE_HARDWARE;
+        attr->config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case PERF_DTLB_MISSES:
+        attr->type = PERF_TYPE_HW_CACHE;
+        attr->config = PERF_COUNT_HW_CACHE_DTLB |
+                       (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PERF_CONTEXT_SWITCHES:
+        attr->type = PERF_TYPE_SOFTWARE;
+        attr->config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+        break;
+    default:
+        break;
+    }
+    // Switches happen in the kernel, so that one must count kernel time;
+    // user-only hardware counts are what an unprivileged user may open
+    attr->exclude_kernel = (e != PERF_CONTEXT_SWITCHES);
+}
+
+// Open every event for the calling thread. Returns the number opened.
+static inline int perf_counters_open(perf_counters_t *pc) {
+    static int warned;
+    int opened = 0;
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        struct perf_event_attr attr;
+        perf_event_attr_for(e, &attr);
+        pc->fds[e] = perf_event_open(&attr, 0, -1, -1, 0);
+        if (pc->fds[e] >= 0) {
+            opened++;
+        } else if ((errno == EACCES || errno == EPERM) && !__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED)) {
+            fprintf(stderr, "perf: %s not permitted; lower "
+                    "/proc/sys/kernel/perf_event_paranoid to count it\n",
+                    perf_event_names[e]);
+        }
+    }
+    return opened;
+}
+
+static inline void perf_counters_start(perf_counters_t *pc) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (pc->fds[e] >= 0) {
+            ioctl(pc->fds[e], PERF_EVENT_IOC_RESET, 0);
+            ioctl(pc->fds[e], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+static inline void perf_counters_stop(perf_counters_t *pc, perf_sample_t *s) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (pc->fds[e] >= 0) {
+            ioctl(pc->fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        unsigned long long buf[3];   // value, time enabled, time running
+        s->counts[e] = 0;
+        s->valid[e] = 0;
+        if (pc->fds[e] < 0 || read(pc->fds[e], buf, sizeof(buf)) != sizeof(buf)) {
+            continue;
+        }
+        s->valid[e] = 1;
+        s->counts[e] = (buf[2] > 0 && buf[2] < buf[1])
+            ? (long long)((double)buf[0] * buf[1] / buf[2])
+            : (long long)buf[0];
+    }
+}
+
+static inline void perf_counters_close(perf_counters_t *pc) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (pc->fds[e] >= 0) {
+            close(pc->fds[e]);
+        }
+        pc->fds[e] = -1;
+    }
+}
+
+// Accumulate s into total; an event stays valid only if every sample had it
+static inline void perf_sample_add(perf_sample_t *total, const perf_sample_t *s, int first) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        total->counts[e] = (first ? 0 : total->counts[e]) + s->counts[e];
+        total->valid[e] = (first ? 1 : total->valid[e]) && s->valid[e];
+    }
+}
+
+#endif // __perf_counters_h__
@@ -0,0 +1,119 @@
+// Barrier latency benchmark: the centralized and dissemination barriers
+// of barrier.c against pthread_barrier_t.
+//
+//   gcc -o barrier-bench barrier-bench.c -Wall -pthread
+//   ./barrier-bench <threads> <episodes> <central|dissem|pthread>
+//
+// barrier.c comes in whole, with its demo main() renamed out of the way
+// so it stays as given.
+
+#include <time.h>
+
+#define main barrier_demo_main
+#include "barrier.c"
+#undef main
+
+typedef struct {
+    int thread_id;
+    int episodes;
+    int use_pthread;
+    pthread_barrier_t *pb;
+    long *exit_ns;           // thread 0 only: time leaving each episode
+} bench_arg_t;
+
+static inline long get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+int cmp_long(const void *a, const void *c) {
+    long x = *(const long *)a, y = *(const long *)c;
+    return (x > y) - (x < y);
+}
+
+void *bench_child(void *arg) {
+    bench_arg_t *a = (bench_arg_t *)arg;
+    for (int e = 0; e < a->episodes; e++) {
+        if (a->use_pthread) {
+            pthread_barrier_wait(a->pb);
+        } else {
+            barrier_wait(&b, a->thread_id);
+        }
+        if (a->exit_ns) {
+            a->exit_ns[e] = get_time_ns();
+        }
+    }
+    return NULL;
+}
+
+// Runs episodes back to back and reports the time between thread 0's
+// successive exits, i.e. the latency of one episode with no work in it
+void run_bench(int num_threads, int episodes, const char *mode) {
+    int use_pthread = strcmp(mode, "pthread") == 0;
+    pthread_barrier_t pb;
+    if (use_pthread) {
+        assert(pthread_barrier_init(&pb, NULL, num_threads) == 0);
+    } else if (strcmp(mode, "central") == 0) {
+        barrier_init_mode(&b, num_threads, BARRIER_CENTRAL);
+    } else if (strcmp(mode, "dissem") == 0) {
+        barrier_init_mode(&b, num_threads, BARRIER_DISSEM);
+    } else {
+        fprintf(stderr, "unknown mode %s (central, dissem or pthread)\n", mode);
+        exit(1);
+    }
+
+    pthread_t p[num_threads];
+    bench_arg_t args[num_threads];
+    long *exit_ns = malloc(episodes * sizeof(long));
+    assert(exit_ns != NULL);
+
+    long start = get_time_ns();
+    for (int i = 0; i < num_threads; i++) {
+        args[i].thread_id = i;
+        args[i].episodes = episodes;
+        args[i].use_pthread = use_pthread;
+        args[i].pb = &pb;
+        args[i].exit_ns = (i == 0) ? exit_ns : NULL;
+        Pthread_create(&p[i], NULL, bench_child, &args[i]);
+    }
+    for (int i = 0; i < num_threads; i++)
+        Pthread_join(p[i], NULL);
+    long total = get_time_ns() - start;
+
+    // The first episode also absorbs thread startup, so skip it
+    int n = episodes - 1;
+    long *lat = malloc((n > 0 ? n : 1) * sizeof(long));
+    for (int e = 0; e < n; e++)
+        lat[e] = exit_ns[e + 1] - exit_ns[e];
+    qsort(lat, n, sizeof(long), cmp_long);
+
+    printf("%s: threads %d, episodes %d, total %.4f sec\n",
+           mode, num_threads, episodes, total / 1e9);
+    if (n > 0) {
+        long sum = 0;
+        for (int e = 0; e < n; e++)
+            sum += lat[e];
+        printf("%s: per episode mean %ld ns, p50 %ld ns, p99 %ld ns, max %ld ns\n",
+               mode, sum / n, lat[n / 2], lat[(long)n * 99 / 100], lat[n - 1]);
+    }
+
+    free(lat);
+    free(exit_ns);
+    if (use_pthread)
+        pthread_barrier_destroy(&pb);
+    else
+        barrier_destroy(&b);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s <threads> <episodes> <central|dissem|pthread>\n", argv[0]);
+        return 1;
+    }
+    int num_threads = atoi(argv[1]);
+    int episodes = atoi(argv[2]);
+    assert(num_threads > 0 && episodes > 0);
+    run_bench(num_threads, episodes, argv[3]);
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "common_threads.h"
@@ -9,39 +10,158 @@
 // before either prints their "after" message. Test by adding sleep(1)
 // calls in various locations.
 
-// You likely need two semaphores to do this correctly, and some
-// other integers to track things.
+// The barrier is reusable: every thread may call barrier() any number of
+// times, and each episode releases once all num_threads have arrived.
+//
+// BARRIER_CENTRAL is a sense-reversing counter barrier: arrivals
+// fetch_add one shared count, and the last one resets it and bumps the
+// episode word everyone else waits on. The episode number is the "sense";
+// using a counter rather than one flipping bit means a sleeping waiter can
+// never miss a flip and flip back.
+//
+// BARRIER_DISSEM is a dissemination barrier: in round k thread i signals
+// thread (i + 2^k) % N and waits for thread (i - 2^k) % N, so an episode
+// takes ceil(log2 N) rounds and no word is written by more than one
+// thread. Each flag counts signals, so it never needs resetting.
+//
+// Waiters spin on their flag for a while and then sleep on it with a
+// futex; wakers only make the syscall if someone is actually asleep.
+
+#define MAX_ROUNDS 16        // dissemination rounds, so up to 2^16 threads
+#define SPIN_LIMIT 2000      // spins before sleeping, on multi-CPU machines
+
+typedef enum {
+    BARRIER_CENTRAL,
+    BARRIER_DISSEM,
+} barrier_mode_t;
+
+// A monotonically increasing word that threads wait on
+typedef struct {
+    int value;
+    int waiters;             // threads asleep (or about to be) on value
+} __attribute__((aligned(64))) flag_t;
 
 typedef struct __barrier_t {
-    int num_threads;       // Total number of threads
-    int count;             // Counter for threads that have arrived
-    sem_t mutex;           // Protects the count variable
-    sem_t barrier;         // Used to block threads at the barrier
+    int num_threads;         // Total number of threads
+    barrier_mode_t mode;
+    int spin_limit;
+    int next_id;             // hands out ids to threads calling barrier()
+    // Centralized
+    int count;               // arrivals this episode
+    flag_t episode;          // bumped by the last arrival
+    // Dissemination
+    int rounds;
+    flag_t *flags;           // flags[i * MAX_ROUNDS + k]: signals to i in round k
+    int *passed;             // per thread: episodes completed
 } barrier_t;
 
 
 // the single barrier we are using for this program
 barrier_t b;
 
-void barrier_init(barrier_t *b, int num_threads) {
+// === Flags ===
+
+static inline int flag_reached(flag_t *f, int target) {
+    return __atomic_load_n(&f->value, __ATOMIC_ACQUIRE) - target >= 0;
+}
+
+// Wait until f->value has reached target
+void flag_wait(flag_t *f, int target, int spin_limit) {
+    for (int i = 0; i < spin_limit; i++) {
+        if (flag_reached(f, target)) {
+            return;
+        }
+        cpu_relax();
+    }
+    for (;;) {
+        int v = __atomic_load_n(&f->value, __ATOMIC_ACQUIRE);
+        if (v - target >= 0) {
+            return;
+        }
+        // Announce before sleeping; the waker either sees us or we see
+        // its store in futex_wait's own check of the value
+        __atomic_fetch_add(&f->waiters, 1, __ATOMIC_SEQ_CST);
+        futex_wait(&f->value, v);
+        __atomic_fetch_sub(&f->waiters, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void flag_advance(flag_t *f) {
+    __atomic_fetch_add(&f->value, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&f->waiters, __ATOMIC_SEQ_CST) > 0) {
+        futex_wake(&f->value, INT_MAX);
+    }
+}
+
+// === Barrier ===
+
+void barrier_init_mode(barrier_t *b, int num_threads, barrier_mode_t mode) {
     b->num_threads = num_threads;
+    b->mode = mode;
+    // Spinning on one CPU only delays the thread we are waiting for
+    b->spin_limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_LIMIT : 0;
+    b->next_id = 0;
     b->count = 0;
-    sem_init(&b->mutex, 0, 1);      // Binary semaphore (mutex) initialized to 1
-    sem_init(&b->barrier, 0, 0);    // Barrier semaphore initialized to 0
+    memset(&b->episode, 0, sizeof(b->episode));
+
+    b->rounds = 0;
+    while ((1 << b->rounds) < num_threads) {
+        b->rounds++;
+    }
+    assert(b->rounds <= MAX_ROUNDS);
+    b->flags = NULL;
+    b->passed = NULL;
+    if (mode == BARRIER_DISSEM) {
+        b->flags = aligned_alloc(64, (size_t)num_threads * MAX_ROUNDS * sizeof(flag_t));
+        assert(b->flags != NULL);
+        memset(b->flags, 0, (size_t)num_threads * MAX_ROUNDS * sizeof(flag_t));
+        b->passed = calloc(num_threads, sizeof(int));
+        assert(b->passed != NULL);
+    }
 }
 
-void barrier(barrier_t *b) {
-    sem_wait(&b->mutex);            // Lock to safely update count
-    b->count++;
-    if (b->count == b->num_threads) {
-        // Last thread to arrive: release all waiting threads
-        for (int i = 0; i < b->num_threads; i++) {
-            sem_post(&b->barrier);
+void barrier_init(barrier_t *b, int num_threads) {
+    barrier_init_mode(b, num_threads, BARRIER_CENTRAL);
+}
+
+void barrier_destroy(barrier_t *b) {
+    free(b->flags);
+    free(b->passed);
+}
+
+// Thread id is in [0, num_threads); each thread must use its own
+void barrier_wait(barrier_t *b, int id) {
+    if (b->mode == BARRIER_CENTRAL) {
+        // Read the episode before arriving; it cannot advance until we do
+        int ep = __atomic_load_n(&b->episode.value, __ATOMIC_ACQUIRE);
+        if (__atomic_add_fetch(&b->count, 1, __ATOMIC_ACQ_REL) == b->num_threads) {
+            // Nobody arrives for the next episode until they see the bump
+            __atomic_store_n(&b->count, 0, __ATOMIC_RELAXED);
+            flag_advance(&b->episode);
+        } else {
+            flag_wait(&b->episode, ep + 1, b->spin_limit);
         }
+        return;
     }
-    sem_post(&b->mutex);            // Unlock
-    
-    sem_wait(&b->barrier);          // Wait at the barrier until released
+
+    int ep = ++b->passed[id];
+    for (int k = 0; k < b->rounds; k++) {
+        int partner = (id + (1 << k)) % b->num_threads;
+        flag_advance(&b->flags[partner * MAX_ROUNDS + k]);
+        flag_wait(&b->flags[id * MAX_ROUNDS + k], ep, b->spin_limit);
+    }
+}
+
+// Assigns each calling thread an id on its first call
+void barrier(barrier_t *b) {
+    static __thread barrier_t *bound;
+    static __thread int id;
+    if (bound != b) {
+        bound = b;
+        id = __atomic_fetch_add(&b->next_id, 1, __ATOMIC_RELAXED);
+        assert(id < b->num_threads);
+    }
+    barrier_wait(b, id);
 }
 
 //
@@ -0,0 +1,414 @@
+#ifndef __lock_profile_h__
+#define __lock_profile_h__
+
+// Lock contention profiler.
+//
+// Build with -DLOCK_PROFILE and every pthread_mutex_lock/trylock/unlock
+// and sem_wait in the program (including the ones behind the common_threads.h
+// macros) is routed through the wrappers below. Each thread keeps its own
+// table keyed by lock address, so recording an acquisition touches no
+// shared memory. For each lock it counts:
+//   acquisitions, and how many found the lock taken (contended)
+//   total and max time spent waiting for it
+//   a log2 histogram of hold times (mutexes and instrumented locks)
+// At exit the tables of all threads are merged and the locks with the
+// most wait time are printed to stderr, hottest first (LOCK_PROFILE_TOP
+// in the environment changes how many, default 20). When a thread exits
+// its table goes on a free list and the next new thread carries on in it,
+// so programs that start fresh threads over and over (bench.h repeats)
+// use as many tables as they ever have threads alive at once.
+//
+// Locks that aren't pthread mutexes can report through
+// LOCK_PROFILE_WAIT_START / LOCK_PROFILE_ACQUIRED / LOCK_PROFILE_RELEASED,
+// and LOCK_PROFILE_NAME(lock, fmt, ...) gives a lock a readable name for
+// the report. Without -DLOCK_PROFILE these macros expand to nothing and
+// the pthread calls are left alone.
+//
+// A mutex held across pthread_cond_wait() counts the time asleep in the
+// condition as hold time.
+//
+// Include this after <pthread.h> and <semaphore.h>; the wrappers replace
+// the function names with macros.
+
+#ifdef LOCK_PROFILE
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <time.h>
+
+#define LP_TABLE_SIZE 4096   // locks tracked per thread, power of two
+#define LP_HIST 32           // hold time buckets: [2^i, 2^(i+1)) ns
+#define LP_MAX_THREADS 1024
+#define LP_MAX_NAMES 4096
+
+typedef struct {
+    void *lock;              // NULL: free entry
+    const char *file;        // first acquisition site
+    int line;
+    long acquisitions;
+    long contended;
+    long wait_total;         // ns
+    long wait_max;
+    long holds;
+    long hold_total;
+    long hold_start;         // this thread's current hold, 0 if none
+    long hold_hist[LP_HIST];
+} lp_entry_t;
+
+typedef struct lp_table {
+    lp_entry_t entries[LP_TABLE_SIZE];
+    long dropped;            // acquisitions of locks that didn't fit
+    struct lp_table *next_free;
+} lp_table_t;
+
+typedef struct {
+    void *lock;
+    char *name;
+} lp_name_t;
+
+static __thread lp_table_t *lp_self;
+static __thread int lp_no_table;     // couldn't get one: count, don't retry
+
+// Registry of per-thread tables and names; only touched on a thread's
+// first acquisition and exit, when naming a lock, and at exit
+static pthread_mutex_t lp_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t lp_key;         // its destructor frees a thread's table
+static lp_table_t *lp_tables[LP_MAX_THREADS];
+static int lp_num_tables;
+static lp_table_t *lp_free_tables;   // of threads that exited
+static int lp_num_threads;
+static long lp_no_table_dropped;     // acquisitions by threads without a table
+static lp_name_t lp_names[LP_MAX_NAMES];
+static int lp_num_names;
+
+static inline long lp_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// A table of an exited thread if there is one, else a new one. Tables
+// stay allocated after their thread exits, for the report.
+static lp_table_t *lp_table_create(void) {
+    (pthread_mutex_lock)(&lp_registry_lock);
+    lp_table_t *t = lp_free_tables;
+    if (t != NULL) {
+        lp_free_tables = t->next_free;
+    } else if (lp_num_tables < LP_MAX_THREADS && (t = calloc(1, sizeof(lp_table_t))) != NULL) {
+        lp_tables[lp_num_tables++] = t;
+    }
+    if (t != NULL) {
+        lp_num_threads++;
+    }
+    (pthread_mutex_unlock)(&lp_registry_lock);
+    if (t != NULL) {
+        pthread_setspecific(lp_key, t);
+    }
+    return t;
+}
+
+// Thread exit: the entries keep their counts for the report, and the
+// next thread to take the table adds to them
+static void lp_table_release(void *arg) {
+    lp_table_t *t = arg;
+    for (int i = 0; i < LP_TABLE_SIZE; i++) {
+        t->entries[i].hold_start = 0;
+    }
+    lp_self = NULL;
+    (pthread_mutex_lock)(&lp_registry_lock);
+    t->next_free = lp_free_tables;
+    lp_free_tables = t;
+    (pthread_mutex_unlock)(&lp_registry_lock);
+}
+
+static inline lp_entry_t *lp_lookup(void *lock, const char *file, int line) {
+    lp_table_t *t = lp_self;
+    if (t == NULL && (lp_no_table || (t = lp_self = lp_table_create()) == NULL)) {
+        lp_no_table = 1;
+        if (file != NULL) {
+            __atomic_fetch_add(&lp_no_table_dropped, 1, __ATOMIC_RELAXED);
+        }
+        return NULL;
+    }
+    uint32_t i = (uint32_t)(((uintptr_t)lock >> 3) * 2654435761u) & (LP_TABLE_SIZE - 1);
+    for (int probes = 0; probes < LP_TABLE_SIZE; probes++) {
+        lp_entry_t *e = &t->entries[i];
+        if (e->lock == lock) {
+            return e;
+        }
+        if (e->lock == NULL) {
+            if (file == NULL) {
+                return NULL;     // release of a lock we never saw acquired
+            }
+            e->lock = lock;
+            e->file = file;
+            e->line = line;
+            return e;
+        }
+        i = (i + 1) & (LP_TABLE_SIZE - 1);
+    }
+    t->dropped++;
+    return NULL;
+}
+
+// wait_start: when the caller started waiting (only used if contended)
+static inline void lock_profile_acquired(void *lock, const char *file, int line,
+                                         long wait_start, int contended) {
+    lp_entry_t *e = lp_lookup(lock, file, line);
+    if (e == NULL) {
+        return;
+    }
+    long now = lp_now();
+    e->acquisitions++;
+    if (contended) {
+        long wait = now - wait_start;
+        e->contended++;
+        e->wait_total += wait;
+        if (wait > e->wait_max) {
+            e->wait_max = wait;
+        }
+    }
+    e->hold_start = now;
+}
+
+static inline void lock_profile_released(void *lock) {
+    lp_entry_t *e = lp_lookup(lock, NULL, 0);
+    if (e == NULL || e->hold_start == 0) {
+        return;
+    }
+    long hold = lp_now() - e->hold_start;
+    e->hold_start = 0;
+    int b = hold > 0 ? 63 - __builtin_clzl(hold) : 0;
+    e->hold_hist[b < LP_HIST ? b : LP_HIST - 1]++;
+    e->holds++;
+    e->hold_total += hold;
+}
+
+static inline int lock_profile_mutex_lock(pthread_mutex_t *m, const char *file, int line) {
+    if ((pthread_mutex_trylock)(m) == 0) {
+        lock_profile_acquired(m, file, line, 0, 0);
+        return 0;
+    }
+    long start = lp_now();
+    int rc = (pthread_mutex_lock)(m);
+    if (rc == 0) {
+        lock_profile_acquired(m, file, line, start, 1);
+    }
+    return rc;
+}
+
+static inline int lock_profile_mutex_trylock(pthread_mutex_t *m, const char *file, int line) {
+    int rc = (pthread_mutex_trylock)(m);
+    if (rc == 0) {
+        lock_profile_acquired(m, file, line, 0, 0);
+    }
+    return rc;
+}
+
+static inline int lock_profile_mutex_unlock(pthread_mutex_t *m) {
+    lock_profile_released(m);
+    return (pthread_mutex_unlock)(m);
+}
+
+// A semaphore has no owner, so only the wait is recorded
+static inline int lock_profile_sem_wait(sem_t *s, const char *file, int line) {
+    if ((sem_trywait)(s) == 0) {
+        lock_profile_acquired(s, file, line, 0, 0);
+    } else {
+        long start = lp_now();
+        int rc = (sem_wait)(s);
+        if (rc != 0) {
+            return rc;
+        }
+        lock_profile_acquired(s, file, line, start, 1);
+    }
+    lp_entry_t *e = lp_lookup(s, NULL, 0);
+    if (e != NULL) {
+        e->hold_start = 0;
+    }
+    return 0;
+}
+
+__attribute__((unused)) static void lock_profile_name(void *lock, const char *fmt, ...) {
+    char buf[128];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    (pthread_mutex_lock)(&lp_registry_lock);
+    int i = 0;
+    while (i < lp_num_names && lp_names[i].lock != lock) {
+        i++;
+    }
+    if (i < lp_num_names) {
+        free(lp_names[i].name);      // lock reused for something else
+    } else if (lp_num_names < LP_MAX_NAMES) {
+        lp_num_names++;
+    } else {
+        (pthread_mutex_unlock)(&lp_registry_lock);
+        return;
+    }
+    lp_names[i].lock = lock;
+    lp_names[i].name = strdup(buf);
+    (pthread_mutex_unlock)(&lp_registry_lock);
+}
+
+// === Report ===
+
+static int lp_cmp_wait(const void *a, const void *b) {
+    const lp_entry_t *x = a, *y = b;
+    if (x->wait_total != y->wait_total) {
+        return x->wait_total < y->wait_total ? 1 : -1;
+    }
+    return x->acquisitions < y->acquisitions ? 1 : (x->acquisitions > y->acquisitions ? -1 : 0);
+}
+
+static const char *lp_name_of(void *lock) {
+    for (int i = 0; i < lp_num_names; i++) {
+        if (lp_names[i].lock == lock) {
+            return lp_names[i].name;
+        }
+    }
+    return NULL;
+}
+
+// Approximate percentile from the histogram: upper bound of its bucket
+static long lp_hold_percentile(lp_entry_t *e, double p) {
+    long want = (long)(e->holds * p), seen = 0;
+    for (int b = 0; b < LP_HIST; b++) {
+        seen += e->hold_hist[b];
+        if (seen > want) {
+            return 2L << b;
+        }
+    }
+    return 2L << (LP_HIST - 1);
+}
+
+static int lp_cmp_lock(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)((const lp_entry_t *)a)->lock;
+    uintptr_t y = (uintptr_t)((const lp_entry_t *)b)->lock;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void lock_profile_report(void) {
+    (pthread_mutex_lock)(&lp_registry_lock);
+    // Gather every thread's entries, sort by lock and fold duplicates
+    long total = 0, dropped = __atomic_load_n(&lp_no_table_dropped, __ATOMIC_RELAXED);
+    for (int t = 0; t < lp_num_tables; t++) {
+        dropped += lp_tables[t]->dropped;
+        for (int i = 0; i < LP_TABLE_SIZE; i++) {
+            total += lp_tables[t]->entries[i].lock != NULL;
+        }
+    }
+    lp_entry_t *all = total > 0 ? malloc(total * sizeof(lp_entry_t)) : NULL;
+    if (all == NULL) {
+        (pthread_mutex_unlock)(&lp_registry_lock);
+        return;
+    }
+    long k = 0;
+    for (int t = 0; t < lp_num_tables; t++) {
+        for (int i = 0; i < LP_TABLE_SIZE; i++) {
+            if (lp_tables[t]->entries[i].lock != NULL) {
+                all[k++] = lp_tables[t]->entries[i];
+            }
+        }
+    }
+    qsort(all, total, sizeof(lp_entry_t), lp_cmp_lock);
+    long n = 0;
+    for (long i = 0; i < total; i++) {
+        lp_entry_t *e = &all[i];
+        if (n == 0 || all[n - 1].lock != e->lock) {
+            all[n++] = *e;
+            continue;
+        }
+        lp_entry_t *m = &all[n - 1];
+        m->acquisitions += e->acquisitions;
+        m->contended += e->contended;
+        m->wait_total += e->wait_total;
+        m->wait_max = e->wait_max > m->wait_max ? e->wait_max : m->wait_max;
+        m->holds += e->holds;
+        m->hold_total += e->hold_total;
+        for (int b = 0; b < LP_HIST; b++) {
+            m->hold_hist[b] += e->hold_hist[b];
+        }
+    }
+    qsort(all, n, sizeof(lp_entry_t), lp_cmp_wait);
+
+    int top = 20;
+    char *env = getenv("LOCK_PROFILE_TOP");
+    if (env != NULL && atoi(env) > 0) {
+        top = atoi(env);
+    }
+    fprintf(stderr, "\n=== Lock profile: %ld locks, %d threads, hottest by wait ===\n", n,
+            lp_num_threads);
+    fprintf(stderr, "%-28s %10s %10s %7s %12s %10s %9s %9s %9s\n", "lock", "acquires",
+            "contended", "cont%", "wait_ns", "max_wait", "hold_avg", "hold_p50", "hold_p99");
+    for (long i = 0; i < n && i < top; i++) {
+        lp_entry_t *e = &all[i];
+        char label[64];
+        const char *name = lp_name_of(e->lock);
+        if (name != NULL) {
+            snprintf(label, sizeof(label), "%s", name);
+        } else {
+            const char *file = strrchr(e->file, '/');
+            snprintf(label, sizeof(label), "%s:%d %p", file ? file + 1 : e->file, e->line,
+                     e->lock);
+        }
+        fprintf(stderr, "%-28s %10ld %10ld %6.2f%% %12ld %10ld", label, e->acquisitions,
+                e->contended, 100.0 * e->contended / (e->acquisitions ? e->acquisitions : 1),
+                e->wait_total, e->wait_max);
+        if (e->holds > 0) {
+            fprintf(stderr, " %9ld %9ld %9ld\n", e->hold_total / e->holds,
+                    lp_hold_percentile(e, 0.5), lp_hold_percentile(e, 0.99));
+        } else {
+            fprintf(stderr, " %9s %9s %9s\n", "-", "-", "-");
+        }
+        if (e->holds > 0 && getenv("LOCK_PROFILE_HIST") != NULL) {
+            fprintf(stderr, "    hold ns:");
+            for (int b = 0; b < LP_HIST; b++) {
+                if (e->hold_hist[b] > 0) {
+                    fprintf(stderr, " <%ld:%ld", 2L << b, e->hold_hist[b]);
+                }
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+    if (dropped > 0) {
+        fprintf(stderr, "(%ld acquisitions not recorded: per-thread table full, or more "
+                "than %d threads at once)\n", dropped, LP_MAX_THREADS);
+    }
+    free(all);
+    (pthread_mutex_unlock)(&lp_registry_lock);
+}
+
+__attribute__((constructor)) static void lock_profile_setup(void) {
+    pthread_key_create(&lp_key, lp_table_release);
+    atexit(lock_profile_report);
+}
+
+#define pthread_mutex_lock(m)    lock_profile_mutex_lock((m), __FILE__, __LINE__)
+#define pthread_mutex_trylock(m) lock_profile_mutex_trylock((m), __FILE__, __LINE__)
+#define pthread_mutex_unlock(m)  lock_profile_mutex_unlock(m)
+#define sem_wait(s)              lock_profile_sem_wait((s), __FILE__, __LINE__)
+
+#define LOCK_PROFILE_WAIT_START()                       lp_now()
+#define LOCK_PROFILE_ACQUIRED(lock, start, contended)   \
+    lock_profile_acquired((lock), __FILE__, __LINE__, (start), (contended))
+#define LOCK_PROFILE_RELEASED(lock)                     lock_profile_released(lock)
+#define LOCK_PROFILE_NAME(lock, ...)                    lock_profile_name((lock), __VA_ARGS__)
+
+#else
+
+#define LOCK_PROFILE_WAIT_START()                       0
+#define LOCK_PROFILE_ACQUIRED(lock, start, contended)   ((void)(start))
+#define LOCK_PROFILE_RELEASED(lock)                     ((void)0)
+#define LOCK_PROFILE_NAME(lock, ...)                    ((void)0)
+
+#endif // LOCK_PROFILE
+
+#endif // __lock_profile_h__
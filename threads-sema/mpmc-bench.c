@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "common_threads.h"
+#include "mpmc_queue.h"
+
+// Producer/consumer benchmark: the lock-free ring in mpmc_queue.h, one
+// item and a batch at a time, against a bounded buffer built from the
+// usual three semaphores (empty slots, full slots, and a mutex).
+//
+// Producers push items_per_producer items each; when they are done the
+// main thread pushes one stop marker per consumer. Each configuration
+// runs at 1:1, N:1 and N:N producers:consumers, and the sum of consumed
+// items is checked against what was produced.
+
+#define BATCH 32
+
+typedef enum {
+    QUEUE_SEM,
+    QUEUE_MPMC,
+    QUEUE_MPMC_BATCH,
+    NUM_QUEUES,
+} queue_kind_t;
+
+static const char *queue_names[] = {
+    [QUEUE_SEM]        = "sem",
+    [QUEUE_MPMC]       = "mpmc",
+    [QUEUE_MPMC_BATCH] = "mpmc-batch",
+};
+
+// Semaphore bounded buffer
+typedef struct {
+    void **buf;
+    int size;
+    int fill;            // next slot to fill, under mutex
+    int use;             // next slot to use, under mutex
+    sem_t empty;
+    sem_t full;
+    sem_t mutex;
+} sem_queue_t;
+
+typedef struct {
+    queue_kind_t kind;
+    sem_queue_t sq;
+    mpmc_queue_t mq;
+} any_queue_t;
+
+typedef struct {
+    any_queue_t *q;
+    long first;          // producers: items first .. first + count - 1
+    long count;
+    long sum;            // consumers: sum of items taken
+    long taken;
+} __attribute__((aligned(64))) bench_arg_t;
+
+#define STOP ((void *)UINTPTR_MAX)
+
+void sem_queue_init(sem_queue_t *q, int size) {
+    q->buf = malloc(size * sizeof(void *));
+    assert(q->buf != NULL);
+    q->size = size;
+    q->fill = q->use = 0;
+    Sem_init(&q->empty, size);
+    Sem_init(&q->full, 0);
+    Sem_init(&q->mutex, 1);
+}
+
+void sem_queue_put(sem_queue_t *q, void *data) {
+    Sem_wait(&q->empty);
+    Sem_wait(&q->mutex);
+    q->buf[q->fill] = data;
+    q->fill = (q->fill + 1) % q->size;
+    Sem_post(&q->mutex);
+    Sem_post(&q->full);
+}
+
+void *sem_queue_get(sem_queue_t *q) {
+    Sem_wait(&q->full);
+    Sem_wait(&q->mutex);
+    void *data = q->buf[q->use];
+    q->use = (q->use + 1) % q->size;
+    Sem_post(&q->mutex);
+    Sem_post(&q->empty);
+    return data;
+}
+
+void put(any_queue_t *q, void *data) {
+    if (q->kind == QUEUE_SEM)
+        sem_queue_put(&q->sq, data);
+    else
+        mpmc_enqueue(&q->mq, data);
+}
+
+void *producer(void *arg) {
+    bench_arg_t *a = (bench_arg_t *)arg;
+    if (a->q->kind == QUEUE_MPMC_BATCH) {
+        void *items[BATCH];
+        for (long i = 0; i < a->count; ) {
+            int n = 0;
+            while (n < BATCH && i < a->count)
+                items[n++] = (void *)(uintptr_t)(a->first + i++);
+            mpmc_enqueue_batch(&a->q->mq, items, n);
+        }
+        return NULL;
+    }
+    for (long i = 0; i < a->count; i++)
+        put(a->q, (void *)(uintptr_t)(a->first + i));
+    return NULL;
+}
+
+void *consumer(void *arg) {
+    bench_arg_t *a = (bench_arg_t *)arg;
+    if (a->q->kind == QUEUE_MPMC_BATCH) {
+        void *items[BATCH];
+        int stops = 0;
+        while (!stops) {
+            int n = mpmc_dequeue_batch(&a->q->mq, items, BATCH);
+            for (int i = 0; i < n; i++) {
+                if (items[i] == STOP) {
+                    stops++;
+                    continue;
+                }
+                a->sum += (uintptr_t)items[i];
+                a->taken++;
+            }
+        }
+        // Hand back stop markers meant for other consumers
+        while (--stops > 0)
+            mpmc_enqueue(&a->q->mq, STOP);
+        return NULL;
+    }
+    for (;;) {
+        void *data = (a->q->kind == QUEUE_SEM) ? sem_queue_get(&a->q->sq)
+                                               : mpmc_dequeue(&a->q->mq);
+        if (data == STOP)
+            break;
+        a->sum += (uintptr_t)data;
+        a->taken++;
+    }
+    return NULL;
+}
+
+static inline long get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void run(queue_kind_t kind, int num_producers, int num_consumers, long items_per_producer,
+         int capacity) {
+    any_queue_t q;
+    q.kind = kind;
+    if (kind == QUEUE_SEM)
+        sem_queue_init(&q.sq, capacity);
+    else
+        mpmc_init(&q.mq, capacity);
+
+    pthread_t pp[num_producers], pc[num_consumers];
+    bench_arg_t prod[num_producers], cons[num_consumers];
+
+    long start = get_time_ns();
+    for (int i = 0; i < num_consumers; i++) {
+        memset(&cons[i], 0, sizeof(cons[i]));
+        cons[i].q = &q;
+        Pthread_create(&pc[i], NULL, consumer, &cons[i]);
+    }
+    for (int i = 0; i < num_producers; i++) {
+        memset(&prod[i], 0, sizeof(prod[i]));
+        prod[i].q = &q;
+        prod[i].first = 1 + i * items_per_producer;   // never NULL
+        prod[i].count = items_per_producer;
+        Pthread_create(&pp[i], NULL, producer, &prod[i]);
+    }
+    for (int i = 0; i < num_producers; i++)
+        Pthread_join(pp[i], NULL);
+    for (int i = 0; i < num_consumers; i++)
+        put(&q, STOP);
+    for (int i = 0; i < num_consumers; i++)
+        Pthread_join(pc[i], NULL);
+    double elapsed = (get_time_ns() - start) / 1e9;
+
+    long total = num_producers * items_per_producer, taken = 0, sum = 0;
+    for (int i = 0; i < num_consumers; i++) {
+        taken += cons[i].taken;
+        sum += cons[i].sum;
+    }
+    printf("%-10s %2d:%-2d %.4f sec, %.3g items/sec", queue_names[kind], num_producers,
+           num_consumers, elapsed, total / elapsed);
+    if (taken != total || sum != total * (total + 1) / 2)
+        printf(", BROKEN (took %ld of %ld)", taken, total);
+    printf("\n");
+
+    if (kind == QUEUE_SEM)
+        free(q.sq.buf);
+    else
+        mpmc_destroy(&q.mq);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "Usage: %s <N> <items_per_producer> [capacity]\n", argv[0]);
+        return 1;
+    }
+    int n = atoi(argv[1]);
+    long items = atol(argv[2]);
+    int capacity = (argc == 4) ? atoi(argv[3]) : 1024;
+    assert(n > 0 && items > 0 && capacity > 0);
+
+    printf("N: %d, Items per producer: %ld, Capacity: %d\n", n, items, capacity);
+    int ratios[][2] = { { 1, 1 }, { n, 1 }, { n, n } };
+    for (int r = 0; r < 3; r++)
+        for (int k = 0; k < NUM_QUEUES; k++)
+            run(k, ratios[r][0], ratios[r][1], items, capacity);
+    return 0;
+}
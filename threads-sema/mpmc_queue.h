@@ -0,0 +1,256 @@
+#ifndef __mpmc_queue_h__
+#define __mpmc_queue_h__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "common_threads.h"
+
+// Bounded multi-producer multi-consumer queue of pointers.
+//
+// The ring follows Vyukov's design: every cell carries a sequence number
+// saying whose turn it is. A producer at position pos may fill the cell
+// once its seq == pos, claims it by CAS on enqueue_pos, stores the item
+// and sets seq = pos + 1; a consumer at pos waits for seq == pos + 1,
+// claims by CAS on dequeue_pos and hands the cell to the next lap with
+// seq = pos + capacity. Producers and consumers only meet on their own
+// position counter, and no lock is ever taken.
+//
+// The blocking calls park on a futex word when the queue is full (or
+// empty). The opposite side bumps that word and wakes a sleeper only if
+// the waiter count says someone is parked, so the non-blocking path
+// costs one fence on top of the ring operation. The batch calls move
+// several items per fence and wakeup.
+//
+// Items may be any pointer except NULL, which the try_ calls use to mean
+// "nothing".
+
+#define MPMC_SPIN 200        // tries before parking, on multi-CPU machines
+
+typedef struct {
+    size_t seq;
+    void *data;
+} mpmc_cell_t;
+
+typedef struct {
+    int seq;                 // futex word, bumped when the other side made progress
+    int waiters;             // threads parked (or about to be) on seq
+} __attribute__((aligned(64))) mpmc_event_t;
+
+typedef struct {
+    mpmc_cell_t *cells;
+    size_t mask;
+    int spin;
+    size_t enqueue_pos __attribute__((aligned(64)));
+    size_t dequeue_pos __attribute__((aligned(64)));
+    mpmc_event_t not_empty;  // consumers park here
+    mpmc_event_t not_full;   // producers park here
+} mpmc_queue_t;
+
+// capacity is rounded up to a power of two
+static inline void mpmc_init(mpmc_queue_t *q, size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+    size_t bytes = size * sizeof(mpmc_cell_t);
+    q->cells = aligned_alloc(64, bytes < 64 ? 64 : bytes);
+    assert(q->cells != NULL);
+    for (size_t i = 0; i < size; i++) {
+        q->cells[i].seq = i;
+        q->cells[i].data = NULL;
+    }
+    q->mask = size - 1;
+    q->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? MPMC_SPIN : 0;
+    q->enqueue_pos = 0;
+    q->dequeue_pos = 0;
+    q->not_empty.seq = q->not_empty.waiters = 0;
+    q->not_full.seq = q->not_full.waiters = 0;
+}
+
+static inline void mpmc_destroy(mpmc_queue_t *q) {
+    free(q->cells);
+    q->cells = NULL;
+}
+
+// === Ring ===
+
+static inline int mpmc_push(mpmc_queue_t *q, void *data) {
+    size_t pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        mpmc_cell_t *c = &q->cells[pos & q->mask];
+        size_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                c->data = data;
+                __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (dif < 0) {
+            return 0;        // full: the consumer of the last lap isn't done
+        } else {
+            pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static inline void *mpmc_pop(mpmc_queue_t *q) {
+    size_t pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        mpmc_cell_t *c = &q->cells[pos & q->mask];
+        size_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                void *data = c->data;
+                __atomic_store_n(&c->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+                return data;
+            }
+        } else if (dif < 0) {
+            return NULL;     // empty
+        } else {
+            pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// === Parking ===
+
+// Wake up to n threads parked on e. The fence orders our ring update
+// before the waiter check (the parker orders them the other way round).
+static inline void mpmc_notify(mpmc_event_t *e, int n) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&e->waiters, __ATOMIC_RELAXED) > 0) {
+        __atomic_fetch_add(&e->seq, 1, __ATOMIC_RELEASE);
+        futex_wake(&e->seq, n);
+    }
+}
+
+// Announce ourselves on e; the caller must retry its ring operation
+// before calling mpmc_park() with the returned token
+static inline int mpmc_prepare_park(mpmc_event_t *e) {
+    int seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+    __atomic_fetch_add(&e->waiters, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return seq;
+}
+
+static inline void mpmc_park(mpmc_event_t *e, int token) {
+    futex_wait(&e->seq, token);
+}
+
+static inline void mpmc_cancel_park(mpmc_event_t *e) {
+    __atomic_fetch_sub(&e->waiters, 1, __ATOMIC_RELAXED);
+}
+
+// === API ===
+
+static inline int mpmc_try_enqueue(mpmc_queue_t *q, void *data) {
+    if (!mpmc_push(q, data)) {
+        return 0;
+    }
+    mpmc_notify(&q->not_empty, 1);
+    return 1;
+}
+
+static inline void *mpmc_try_dequeue(mpmc_queue_t *q) {
+    void *data = mpmc_pop(q);
+    if (data) {
+        mpmc_notify(&q->not_full, 1);
+    }
+    return data;
+}
+
+static inline void mpmc_enqueue(mpmc_queue_t *q, void *data) {
+    for (int i = 0; i < q->spin; i++) {
+        if (mpmc_try_enqueue(q, data)) {
+            return;
+        }
+        cpu_relax();
+    }
+    for (;;) {
+        int token = mpmc_prepare_park(&q->not_full);
+        int done = mpmc_push(q, data);
+        if (!done) {
+            mpmc_park(&q->not_full, token);
+        }
+        mpmc_cancel_park(&q->not_full);
+        if (done || mpmc_push(q, data)) {
+            mpmc_notify(&q->not_empty, 1);
+            return;
+        }
+    }
+}
+
+static inline void *mpmc_dequeue(mpmc_queue_t *q) {
+    void *data;
+    for (int i = 0; i < q->spin; i++) {
+        if ((data = mpmc_try_dequeue(q)) != NULL) {
+            return data;
+        }
+        cpu_relax();
+    }
+    for (;;) {
+        int token = mpmc_prepare_park(&q->not_empty);
+        data = mpmc_pop(q);
+        if (!data) {
+            mpmc_park(&q->not_empty, token);
+        }
+        mpmc_cancel_park(&q->not_empty);
+        if (data || (data = mpmc_pop(q)) != NULL) {
+            mpmc_notify(&q->not_full, 1);
+            return data;
+        }
+    }
+}
+
+// Enqueue as many of items[0..n) as fit without blocking; returns how many
+static inline int mpmc_try_enqueue_batch(mpmc_queue_t *q, void **items, int n) {
+    int done = 0;
+    while (done < n && mpmc_push(q, items[done])) {
+        done++;
+    }
+    if (done > 0) {
+        mpmc_notify(&q->not_empty, done);
+    }
+    return done;
+}
+
+// Enqueue all of items[0..n), blocking while the queue is full
+static inline void mpmc_enqueue_batch(mpmc_queue_t *q, void **items, int n) {
+    int done = mpmc_try_enqueue_batch(q, items, n);
+    while (done < n) {
+        // Take the slow path for one item, then go back to batching
+        mpmc_enqueue(q, items[done++]);
+        done += mpmc_try_enqueue_batch(q, items + done, n - done);
+    }
+}
+
+// Dequeue up to max items without blocking; returns how many
+static inline int mpmc_try_dequeue_batch(mpmc_queue_t *q, void **out, int max) {
+    int got = 0;
+    while (got < max && (out[got] = mpmc_pop(q)) != NULL) {
+        got++;
+    }
+    if (got > 0) {
+        mpmc_notify(&q->not_full, got);
+    }
+    return got;
+}
+
+// Dequeue between 1 and max items, blocking while the queue is empty
+static inline int mpmc_dequeue_batch(mpmc_queue_t *q, void **out, int max) {
+    int got = mpmc_try_dequeue_batch(q, out, max);
+    if (got > 0) {
+        return got;
+    }
+    out[0] = mpmc_dequeue(q);
+    return 1 + mpmc_try_dequeue_batch(q, out + 1, max - 1);
+}
+
+#endif // __mpmc_queue_h__
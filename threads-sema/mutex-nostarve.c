@@ -1,6 +1,8 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "common_threads.h"
@@ -11,106 +13,201 @@
 // when attempting to acquire this mutex you build?
 //
 
+// Ticket lock: acquire takes the next ticket with one fetch_add and owns
+// the lock once now_serving reaches it, so threads get the lock in the
+// order they arrived (FIFO, no starvation). An uncontended acquire is
+// that single atomic; release is a store plus a load.
+//
+// Waiters spin briefly, then sleep on a futex. Sleepers are spread over
+// TICKET_SLOTS words by ticket number so a release wakes only the slot of
+// the next ticket rather than every waiter.
+
+#define TICKET_SLOTS 64
+#define SPIN_LIMIT 1000      // spins before sleeping, on multi-CPU machines
+
+typedef struct {
+	int seq;             // futex word, bumped when this slot's ticket is up
+	int waiters;         // threads asleep (or about to be) on seq
+} __attribute__((aligned(64))) ticket_slot_t;
+
 typedef struct __ns_mutex_t {
-	sem_t mutex;  // Protects the waiting counter
-	sem_t room;   // The actual lock (1 = available, 0 = taken)
-	sem_t queue;  // FIFO queue for waiting threads
-	int waiting;  // Number of threads waiting
+	unsigned next_ticket __attribute__((aligned(64)));
+	unsigned now_serving __attribute__((aligned(64)));
+	int spin_limit;
+	ticket_slot_t slots[TICKET_SLOTS];
 } ns_mutex_t;
 
-int counter = 0;  // Shared counter to test mutex
+long counter = 0;  // Shared counter to test mutex
 ns_mutex_t m;
 
 void ns_mutex_init(ns_mutex_t *m) {
-	m->waiting = 0;
-	sem_init(&m->mutex, 0, 1);  // Binary semaphore for protecting counter
-	sem_init(&m->room, 0, 1);   // The actual lock (starts available)
-	sem_init(&m->queue, 0, 0);  // Queue starts empty
+	memset(m, 0, sizeof(*m));
+	// Spinning on one CPU only delays the holder
+	m->spin_limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_LIMIT : 0;
+	LOCK_PROFILE_NAME(m, "ticket lock");
 }
 
 void ns_mutex_acquire(ns_mutex_t *m) {
-	sem_wait(&m->mutex);  // Protect the waiting counter
-
-	if (m->waiting > 0 || sem_trywait(&m->room) != 0) {
-		// Either someone is waiting OR the room is taken
-		// Join the queue to ensure FIFO ordering
-		m->waiting++;
-		sem_post(&m->mutex);  // Release counter protection
-		sem_wait(&m->queue);  // Wait in FIFO queue
-				      // When woken up, we have the lock
-	} else {
-		// Got the room immediately (sem_trywait succeeded)
-		sem_post(&m->mutex);  // Release counter protection
+	unsigned ticket = __atomic_fetch_add(&m->next_ticket, 1, __ATOMIC_RELAXED);
+	if (__atomic_load_n(&m->now_serving, __ATOMIC_ACQUIRE) == ticket) {
+		LOCK_PROFILE_ACQUIRED(m, 0, 0);
+		return;
+	}
+
+	long t0 = LOCK_PROFILE_WAIT_START();
+	for (int i = 0; i < m->spin_limit; i++) {
+		cpu_relax();
+		if (__atomic_load_n(&m->now_serving, __ATOMIC_ACQUIRE) == ticket) {
+			LOCK_PROFILE_ACQUIRED(m, t0, 1);
+			return;
+		}
+	}
+
+	ticket_slot_t *s = &m->slots[ticket % TICKET_SLOTS];
+	for (;;) {
+		int seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		// Announce, then recheck: release either sees us waiting or we
+		// see its now_serving store
+		__atomic_fetch_add(&s->waiters, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&m->now_serving, __ATOMIC_SEQ_CST) == ticket) {
+			__atomic_fetch_sub(&s->waiters, 1, __ATOMIC_RELAXED);
+			break;
+		}
+		futex_wait(&s->seq, seq);
+		__atomic_fetch_sub(&s->waiters, 1, __ATOMIC_RELAXED);
+		if (__atomic_load_n(&m->now_serving, __ATOMIC_ACQUIRE) == ticket)
+			break;
 	}
+	LOCK_PROFILE_ACQUIRED(m, t0, 1);
 }
 
 void ns_mutex_release(ns_mutex_t *m) {
-	sem_wait(&m->mutex);  // Protect the waiting counter
-
-	if (m->waiting > 0) {
-		// Wake up next thread in queue
-		m->waiting--;
-		sem_post(&m->queue);  // Pass lock directly to next waiter
-	} else {
-		// No one waiting, release the room
-		sem_post(&m->room);  // Make room available
+	LOCK_PROFILE_RELEASED(m);
+	// Only the holder writes now_serving
+	unsigned next = __atomic_load_n(&m->now_serving, __ATOMIC_RELAXED) + 1;
+	__atomic_store_n(&m->now_serving, next, __ATOMIC_SEQ_CST);
+
+	ticket_slot_t *s = &m->slots[next % TICKET_SLOTS];
+	if (__atomic_load_n(&s->waiters, __ATOMIC_SEQ_CST) > 0) {
+		__atomic_fetch_add(&s->seq, 1, __ATOMIC_RELEASE);
+		futex_wake(&s->seq, INT_MAX);
 	}
+}
 
-	sem_post(&m->mutex);  // Release counter protection
+// === Benchmark ===
+// Each thread acquires and releases as fast as it can for a fixed time.
+// Total acquisitions/sec shows speed; how evenly acquisitions and wait
+// times are spread over the threads shows fairness.
+
+typedef struct {
+	int thread_id;
+	int use_pthread;
+	long acquisitions;
+	long total_wait_ns;
+	long max_wait_ns;
+} __attribute__((aligned(64))) worker_arg_t;
+
+pthread_mutex_t pm = PTHREAD_MUTEX_INITIALIZER;
+int stop = 0;
+int cs_work = 0;     // extra iterations inside the critical section
+
+static inline long get_time_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
 }
 
 void *worker(void *arg) {
-	int thread_id = *(int *)arg;
-	int i;
+	worker_arg_t *a = (worker_arg_t *)arg;
 
-	for (i = 0; i < 5; i++) {
-		printf("Thread %d: attempting to acquire mutex\n", thread_id);
-		ns_mutex_acquire(&m);
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		long t0 = get_time_ns();
+		if (a->use_pthread) {
+			Pthread_mutex_lock(&pm);
+		} else {
+			ns_mutex_acquire(&m);
+		}
+		long wait = get_time_ns() - t0;
 
 		// Critical section
-		printf("Thread %d: ACQUIRED mutex (counter = %d)\n", thread_id,
-		       counter);
 		counter++;
-		sleep(1);  // Simulate work to make starvation visible
-		printf("Thread %d: RELEASING mutex (counter = %d)\n", thread_id,
-		       counter);
-
-		ns_mutex_release(&m);
-
-		// Small delay before trying again
-		usleep(100000);
+		for (volatile int i = 0; i < cs_work; i++)
+			;
+
+		if (a->use_pthread) {
+			Pthread_mutex_unlock(&pm);
+		} else {
+			ns_mutex_release(&m);
+		}
+
+		a->acquisitions++;
+		a->total_wait_ns += wait;
+		if (wait > a->max_wait_ns)
+			a->max_wait_ns = wait;
 	}
 
 	return NULL;
 }
 
 int main(int argc, char *argv[]) {
-	printf("parent: begin\n");
-
-	if (argc != 2) {
-		fprintf(stderr, "Usage: %s <num_threads>\n", argv[0]);
+	if (argc < 2 || argc > 5) {
+		fprintf(stderr, "Usage: %s <num_threads> [duration_ms] [cs_work] "
+			"[ticket|pthread]\n", argv[0]);
 		return 1;
 	}
 
 	int num_threads = atoi(argv[1]);
+	int duration_ms = (argc > 2) ? atoi(argv[2]) : 1000;
+	cs_work = (argc > 3) ? atoi(argv[3]) : 0;
+	int use_pthread = (argc > 4) && strcmp(argv[4], "pthread") == 0;
+	if (num_threads < 1 || duration_ms < 1) {
+		fprintf(stderr, "num_threads and duration_ms must be positive\n");
+		return 1;
+	}
+
 	pthread_t threads[num_threads];
-	int thread_ids[num_threads];
+	worker_arg_t args[num_threads];
 
 	ns_mutex_init(&m);
 
 	// Create threads
 	for (int i = 0; i < num_threads; i++) {
-		thread_ids[i] = i;
-		Pthread_create(&threads[i], NULL, worker, &thread_ids[i]);
+		memset(&args[i], 0, sizeof(args[i]));
+		args[i].thread_id = i;
+		args[i].use_pthread = use_pthread;
+		Pthread_create(&threads[i], NULL, worker, &args[i]);
 	}
 
+	long start = get_time_ns();
+	usleep(duration_ms * 1000);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
 	// Wait for all threads
 	for (int i = 0; i < num_threads; i++) {
 		Pthread_join(threads[i], NULL);
 	}
+	double elapsed = (get_time_ns() - start) / 1e9;
+
+	long total = 0, min_acq = args[0].acquisitions, max_acq = 0, max_wait = 0;
+	for (int i = 0; i < num_threads; i++) {
+		worker_arg_t *a = &args[i];
+		printf("Thread %d: %ld acquisitions, mean wait %ld ns, max wait %ld ns\n",
+		       i, a->acquisitions,
+		       a->acquisitions ? a->total_wait_ns / a->acquisitions : 0,
+		       a->max_wait_ns);
+		total += a->acquisitions;
+		if (a->acquisitions < min_acq)
+			min_acq = a->acquisitions;
+		if (a->acquisitions > max_acq)
+			max_acq = a->acquisitions;
+		if (a->max_wait_ns > max_wait)
+			max_wait = a->max_wait_ns;
+	}
 
-	printf("Final counter value: %d (expected: %d)\n", counter,
-	       num_threads * 5);
-	printf("parent: end\n");
-	return 0;
+	printf("%s: %d threads, %.0f acquisitions/sec\n",
+	       use_pthread ? "pthread" : "ticket", num_threads, total / elapsed);
+	printf("Spread: acquisitions min %ld / max %ld per thread, worst wait %ld ns\n",
+	       min_acq, max_acq, max_wait);
+	printf("Final counter value: %ld (expected: %ld)\n", counter, total);
+	return counter == total ? 0 : 1;
 }
@@ -2,58 +2,40 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include "common_threads.h"
+#include "rwlock.h"
 
 //
 // Your code goes in the structure and functions below
 //
 
+// Readers mark themselves in per-thread slots and writers drain them (see
+// rwlock.h), so readers no longer serialize on a shared counter or a
+// turnstile. Phase-fair: the readers that waited out a writer all get in
+// before the next writer, so neither side starves.
+
 typedef struct __rwlock_t {
-    sem_t lock;          // Protects readers counter
-    sem_t writelock;     // Ensures exclusive writer access
-    sem_t turnstile;     // Ensures fairness (FIFO ordering)
-    int readers;         // Count of active readers
+    srwlock_t rw;
 } rwlock_t;
 
 
 void rwlock_init(rwlock_t *rw) {
-    rw->readers = 0;
-    sem_init(&rw->lock, 0, 1);
-    sem_init(&rw->writelock, 0, 1);
-    sem_init(&rw->turnstile, 0, 1);  // Turnstile for fairness
+    srwlock_init(&rw->rw, SRW_PHASE_FAIR);
 }
 
 void rwlock_acquire_readlock(rwlock_t *rw) {
-    sem_wait(&rw->turnstile);     // Wait in line (fairness)
-    sem_post(&rw->turnstile);     // Immediately release (readers don't block each other)
-    
-    sem_wait(&rw->lock);
-    rw->readers++;
-    if (rw->readers == 1) {
-        // First reader locks out writers
-        sem_wait(&rw->writelock);
-    }
-    sem_post(&rw->lock);
+    srwlock_read_lock(&rw->rw);
 }
 
 void rwlock_release_readlock(rwlock_t *rw) {
-    sem_wait(&rw->lock);
-    rw->readers--;
-    if (rw->readers == 0) {
-        // Last reader unlocks for writers
-        sem_post(&rw->writelock);
-    }
-    sem_post(&rw->lock);
+    srwlock_read_unlock(&rw->rw);
 }
 
 void rwlock_acquire_writelock(rwlock_t *rw) {
-    sem_wait(&rw->turnstile);     // Wait in line (fairness)
-    sem_wait(&rw->writelock);     // Acquire exclusive access
-    // Note: turnstile is NOT released yet - blocks all new readers/writers
+    srwlock_write_lock(&rw->rw);
 }
 
 void rwlock_release_writelock(rwlock_t *rw) {
-    sem_post(&rw->turnstile);     // Release turnstile for next in line
-    sem_post(&rw->writelock);     // Release exclusive access
+    srwlock_write_unlock(&rw->rw);
 }
 
 //
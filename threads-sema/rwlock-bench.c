@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "common_threads.h"
+#include "rwlock.h"
+#include "seqlock.h"
+
+// Non-printing reader-writer lock benchmark.
+//
+// Every thread does ops_per_thread operations on a small shared "config"
+// record: reads copy it out, writes bump every field. The mix of reads
+// and writes is swept over 99/1, 90/10 and 50/50 (or given on the command
+// line), and the thread count over powers of two up to <threads>, for
+// each lock:
+//   sem         the original semaphore lock (readers share one counter)
+//   pthread     pthread_rwlock_t
+//   slots-wp    rwlock.h, writer preference
+//   slots-pf    rwlock.h, phase-fair
+//   seqlock     seqlock.h; readers write nothing shared and retry
+// Reads/sec per thread staying flat as threads are added is scaling. A
+// read whose copy has fields that disagree means a writer got in
+// alongside it; those are counted and reported.
+
+#define CONFIG_FIELDS 8
+
+typedef enum {
+    LOCK_SEM,
+    LOCK_PTHREAD,
+    LOCK_SLOTS_WP,
+    LOCK_SLOTS_PF,
+    LOCK_SEQLOCK,
+    NUM_LOCKS,
+} lock_kind_t;
+
+static const char *lock_names[] = {
+    [LOCK_SEM]      = "sem",
+    [LOCK_PTHREAD]  = "pthread",
+    [LOCK_SLOTS_WP] = "slots-wp",
+    [LOCK_SLOTS_PF] = "slots-pf",
+    [LOCK_SEQLOCK]  = "seqlock",
+};
+
+// The semaphore reader-writer lock this directory started with
+typedef struct {
+    sem_t lock;          // Protects readers counter
+    sem_t writelock;     // Ensures exclusive writer access
+    int readers;         // Count of active readers
+} sem_rwlock_t;
+
+typedef struct {
+    lock_kind_t kind;
+    sem_rwlock_t sem;
+    pthread_rwlock_t prw;
+    srwlock_t srw;
+    seqlock_t seq;
+} any_lock_t;
+
+typedef struct {
+    long fields[CONFIG_FIELDS];
+} config_t;
+
+typedef struct {
+    any_lock_t *lock;
+    int ops;
+    int read_pct;
+    unsigned seed;
+    long reads;
+    long torn;           // reads that saw a half-done write
+} __attribute__((aligned(64))) bench_arg_t;
+
+config_t config;
+
+void sem_rwlock_init(sem_rwlock_t *rw) {
+    rw->readers = 0;
+    Sem_init(&rw->lock, 1);
+    Sem_init(&rw->writelock, 1);
+}
+
+void sem_rwlock_read_lock(sem_rwlock_t *rw) {
+    Sem_wait(&rw->lock);
+    if (++rw->readers == 1)
+        Sem_wait(&rw->writelock);
+    Sem_post(&rw->lock);
+}
+
+void sem_rwlock_read_unlock(sem_rwlock_t *rw) {
+    Sem_wait(&rw->lock);
+    if (--rw->readers == 0)
+        Sem_post(&rw->writelock);
+    Sem_post(&rw->lock);
+}
+
+void lock_init(any_lock_t *l, lock_kind_t kind) {
+    l->kind = kind;
+    switch (kind) {
+    case LOCK_SEM:
+        sem_rwlock_init(&l->sem);
+        break;
+    case LOCK_PTHREAD:
+        assert(pthread_rwlock_init(&l->prw, NULL) == 0);
+        break;
+    case LOCK_SLOTS_WP:
+        srwlock_init(&l->srw, SRW_PREFER_WRITER);
+        break;
+    case LOCK_SLOTS_PF:
+        srwlock_init(&l->srw, SRW_PHASE_FAIR);
+        break;
+    case LOCK_SEQLOCK:
+        seqlock_init(&l->seq);
+        break;
+    default:
+        break;
+    }
+}
+
+void lock_destroy(any_lock_t *l) {
+    switch (l->kind) {
+    case LOCK_SEM:
+        sem_destroy(&l->sem.lock);
+        sem_destroy(&l->sem.writelock);
+        break;
+    case LOCK_PTHREAD:
+        pthread_rwlock_destroy(&l->prw);
+        break;
+    case LOCK_SEQLOCK:
+        seqlock_destroy(&l->seq);
+        break;
+    default:
+        srwlock_destroy(&l->srw);
+        break;
+    }
+}
+
+static inline void read_lock(any_lock_t *l) {
+    switch (l->kind) {
+    case LOCK_SEM:     sem_rwlock_read_lock(&l->sem); break;
+    case LOCK_PTHREAD: pthread_rwlock_rdlock(&l->prw); break;
+    default:           srwlock_read_lock(&l->srw); break;
+    }
+}
+
+static inline void read_unlock(any_lock_t *l) {
+    switch (l->kind) {
+    case LOCK_SEM:     sem_rwlock_read_unlock(&l->sem); break;
+    case LOCK_PTHREAD: pthread_rwlock_unlock(&l->prw); break;
+    default:           srwlock_read_unlock(&l->srw); break;
+    }
+}
+
+static inline void write_lock(any_lock_t *l) {
+    switch (l->kind) {
+    case LOCK_SEM:     Sem_wait(&l->sem.writelock); break;
+    case LOCK_PTHREAD: pthread_rwlock_wrlock(&l->prw); break;
+    case LOCK_SEQLOCK: seqlock_write_lock(&l->seq); break;
+    default:           srwlock_write_lock(&l->srw); break;
+    }
+}
+
+static inline void write_unlock(any_lock_t *l) {
+    switch (l->kind) {
+    case LOCK_SEM:     Sem_post(&l->sem.writelock); break;
+    case LOCK_PTHREAD: pthread_rwlock_unlock(&l->prw); break;
+    case LOCK_SEQLOCK: seqlock_write_unlock(&l->seq); break;
+    default:           srwlock_write_unlock(&l->srw); break;
+    }
+}
+
+void *worker(void *arg) {
+    bench_arg_t *a = (bench_arg_t *)arg;
+    for (int i = 0; i < a->ops; i++) {
+        if ((int)(rand_r(&a->seed) % 100) < a->read_pct) {
+            config_t copy;
+            if (a->lock->kind == LOCK_SEQLOCK) {
+                SEQLOCK_READ(&a->lock->seq, &copy, &config);
+            } else {
+                read_lock(a->lock);
+                seqlock_copy(&copy, &config, sizeof(config));
+                read_unlock(a->lock);
+            }
+            for (int f = 1; f < CONFIG_FIELDS; f++) {
+                if (copy.fields[f] != copy.fields[0])
+                    a->torn++;
+            }
+            a->reads++;
+        } else {
+            write_lock(a->lock);
+            for (int f = 0; f < CONFIG_FIELDS; f++)
+                __atomic_store_n(&config.fields[f], config.fields[f] + 1, __ATOMIC_RELAXED);
+            write_unlock(a->lock);
+        }
+    }
+    return NULL;
+}
+
+static inline long get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void run(lock_kind_t kind, int num_threads, int ops, int read_pct) {
+    any_lock_t lock;
+    lock_init(&lock, kind);
+    memset(&config, 0, sizeof(config));
+
+    pthread_t p[num_threads];
+    bench_arg_t args[num_threads];
+    long start = get_time_ns();
+    for (int i = 0; i < num_threads; i++) {
+        memset(&args[i], 0, sizeof(args[i]));
+        args[i].lock = &lock;
+        args[i].ops = ops;
+        args[i].read_pct = read_pct;
+        args[i].seed = i + 1;    // same op streams for every lock
+        Pthread_create(&p[i], NULL, worker, &args[i]);
+    }
+    for (int i = 0; i < num_threads; i++)
+        Pthread_join(p[i], NULL);
+    double elapsed = (get_time_ns() - start) / 1e9;
+
+    long reads = 0, torn = 0;
+    for (int i = 0; i < num_threads; i++) {
+        reads += args[i].reads;
+        torn += args[i].torn;
+    }
+    long writes = (long)num_threads * ops - reads;
+    printf("%-8s %d/%d, %2d threads: %.4f sec, %.3g ops/sec, %.3g reads/sec per thread",
+           lock_names[kind], read_pct, 100 - read_pct, num_threads, elapsed,
+           num_threads * (double)ops / elapsed, reads / elapsed / num_threads);
+    if (torn > 0 || config.fields[0] != writes)
+        printf(", BROKEN (torn reads %ld, writes %ld of %ld)", torn, config.fields[0],
+               writes);
+    printf("\n");
+
+    lock_destroy(&lock);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "Usage: %s <max_threads> <ops_per_thread> [read_pct]\n", argv[0]);
+        return 1;
+    }
+    int num_threads = atoi(argv[1]);
+    int ops = atoi(argv[2]);
+    assert(num_threads > 0 && ops > 0);
+
+    int mixes[] = { 99, 90, 50 };
+    int num_mixes = 3;
+    if (argc == 4) {
+        mixes[0] = atoi(argv[3]);
+        num_mixes = 1;
+    }
+
+    printf("Threads: up to %d, Ops per thread: %d\n", num_threads, ops);
+    for (int m = 0; m < num_mixes; m++) {
+        for (int k = 0; k < NUM_LOCKS; k++) {
+            for (int n = 1; n < num_threads; n *= 2)
+                run(k, n, ops, mixes[m]);
+            run(k, num_threads, ops, mixes[m]);
+        }
+    }
+    return 0;
+}
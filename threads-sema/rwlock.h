@@ -0,0 +1,268 @@
+#ifndef __rwlock_h__
+#define __rwlock_h__
+
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "common_threads.h"
+
+// Scalable reader-writer lock.
+//
+// A reader announces itself by incrementing a counter in its own slot
+// (one cache line per slot, threads assigned round-robin), then checks
+// the writer word; if no writer is about, it is in. Readers never write
+// a shared line, so read acquisition does not serialize. A writer takes
+// the writer mutex, raises the writer word and drains every slot to zero.
+// The slot increment and the writer word are both seq_cst, so either the
+// reader sees the writer or the writer sees the reader (Dekker).
+//
+// Policies:
+//   SRW_PREFER_WRITER  the writer word counts pending writers; readers
+//                      back off while any writer is waiting or active.
+//                      Readers can starve under a steady write stream.
+//   SRW_PHASE_FAIR     the writer word counts pending writers here too,
+//                      but readers that arrive while it is up register
+//                      with the writer phase, and the writer admits all
+//                      of them on its way out, before the next writer can
+//                      drain. Each read phase is bounded by the readers
+//                      that registered, so reads and writes alternate and
+//                      neither side starves. Admission is done for the
+//                      readers (counted in handoff), so the next writer
+//                      need not wait for them to be scheduled first.
+//                      That bounds how long a writer waits for the lock,
+//                      not how often it runs: on one CPU the readers a
+//                      writer wakes on its way out preempt it, and read
+//                      freely until the scheduler runs it again, so a
+//                      writer with no think time between writes gets
+//                      about one write per scheduler tick.
+//
+// Waits spin briefly on multi-CPU machines and then sleep on a futex;
+// the thread that makes the awaited word zero wakes sleepers only if
+// there are any.
+
+#define SRW_SLOTS 64
+#define SRW_SPIN 1000
+
+typedef enum {
+    SRW_PREFER_WRITER,
+    SRW_PHASE_FAIR,
+} srw_policy_t;
+
+typedef struct {
+    int count;               // readers inside (or entering) via this slot
+    int waiters;             // writer asleep on count
+} __attribute__((aligned(64))) srw_slot_t;
+
+typedef struct {
+    srw_slot_t slots[SRW_SLOTS];
+    int writer __attribute__((aligned(64)));   // nonzero: readers keep out
+    int writer_waiters;      // readers asleep on writer
+    // Phase-fair: phase in the high half, readers waiting for the current
+    // writer to admit them in the low half
+    unsigned long admit __attribute__((aligned(64)));
+    int phase;               // futex word, high half of admit once published
+    int phase_waiters;
+    int handoff;             // admitted readers not yet in their slot
+    int handoff_waiters;
+    srw_policy_t policy;
+    int spin;
+    pthread_mutex_t wmutex;  // serializes writers
+} srwlock_t;
+
+static int srw_next_slot;
+static __thread int srw_slot = -1;
+
+static inline srw_slot_t *srw_my_slot(srwlock_t *l) {
+    if (srw_slot < 0) {
+        srw_slot = __atomic_fetch_add(&srw_next_slot, 1, __ATOMIC_SEQ_CST) % SRW_SLOTS;
+    }
+    return &l->slots[srw_slot];
+}
+
+// Wait until *word == 0; returns whether it wasn't already
+static inline int srw_wait_zero(int *word, int *waiters, int spin) {
+    for (int i = 0; i < spin; i++) {
+        if (__atomic_load_n(word, __ATOMIC_ACQUIRE) == 0) {
+            return i > 0;
+        }
+        cpu_relax();
+    }
+    for (int waited = spin > 0;; waited = 1) {
+        int v = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+        if (v == 0) {
+            return waited;
+        }
+        __atomic_fetch_add(waiters, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(word, __ATOMIC_SEQ_CST) != 0) {
+            futex_wait(word, v);
+        }
+        __atomic_fetch_sub(waiters, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Wait until *word has moved past phase (mod 2^32)
+static inline void srw_wait_phase(int *word, int phase, int *waiters, int spin) {
+    for (int i = 0; i < spin; i++) {
+        if (__atomic_load_n(word, __ATOMIC_ACQUIRE) - phase > 0) {
+            return;
+        }
+        cpu_relax();
+    }
+    for (;;) {
+        int v = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+        if (v - phase > 0) {
+            return;
+        }
+        __atomic_fetch_add(waiters, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(word, __ATOMIC_SEQ_CST) == v) {
+            futex_wait(word, v);
+        }
+        __atomic_fetch_sub(waiters, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Call after making *word zero
+static inline void srw_wake_zero(int *word, int *waiters) {
+    if (__atomic_load_n(waiters, __ATOMIC_SEQ_CST) > 0) {
+        futex_wake(word, INT_MAX);
+    }
+}
+
+static inline void srwlock_init(srwlock_t *l, srw_policy_t policy) {
+    memset(l, 0, sizeof(*l));
+    l->policy = policy;
+    l->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SRW_SPIN : 0;
+    pthread_mutex_init(&l->wmutex, NULL);
+    LOCK_PROFILE_NAME(&l->slots, "srwlock %p read", (void *)l);
+    LOCK_PROFILE_NAME(&l->writer, "srwlock %p write", (void *)l);
+    LOCK_PROFILE_NAME(&l->wmutex, "srwlock %p wmutex", (void *)l);
+}
+
+static inline void srwlock_destroy(srwlock_t *l) {
+    pthread_mutex_destroy(&l->wmutex);
+}
+
+static inline void srw_slot_leave(srw_slot_t *s) {
+    if (__atomic_sub_fetch(&s->count, 1, __ATOMIC_SEQ_CST) == 0) {
+        srw_wake_zero(&s->count, &s->waiters);
+    }
+}
+
+// Phase-fair slow path: register with the writer and wait to be admitted
+static inline void srw_read_lock_fair(srwlock_t *l, srw_slot_t *s) {
+    for (;;) {
+        unsigned long old = __atomic_fetch_add(&l->admit, 1, __ATOMIC_SEQ_CST);
+        int phase = old >> 32;
+        if (__atomic_load_n(&l->writer, __ATOMIC_SEQ_CST) == 0) {
+            // The writer left before it could have seen us: withdraw,
+            // unless it admitted us after all
+            unsigned long cur = old + 1;
+            while ((int)(cur >> 32) == phase &&
+                   !__atomic_compare_exchange_n(&l->admit, &cur, cur - 1, 0,
+                                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            }
+            if ((int)(cur >> 32) == phase) {
+                __atomic_fetch_add(&s->count, 1, __ATOMIC_SEQ_CST);
+                if (__atomic_load_n(&l->writer, __ATOMIC_SEQ_CST) == 0) {
+                    return;
+                }
+                srw_slot_leave(s);
+                continue;
+            }
+        }
+        // Any writer we saw ends by bumping the phase and admitting us
+        srw_wait_phase(&l->phase, phase, &l->phase_waiters, l->spin);
+        // Take the slot before giving up our handoff count, so the next
+        // writer, which drains handoff first, can't miss us
+        __atomic_fetch_add(&s->count, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_sub_fetch(&l->handoff, 1, __ATOMIC_SEQ_CST) == 0) {
+            srw_wake_zero(&l->handoff, &l->handoff_waiters);
+        }
+        return;
+    }
+}
+
+static inline void srwlock_read_lock(srwlock_t *l) {
+    srw_slot_t *s = srw_my_slot(l);
+    __atomic_fetch_add(&s->count, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&l->writer, __ATOMIC_SEQ_CST) == 0) {
+        LOCK_PROFILE_ACQUIRED(&l->slots, 0, 0);
+        return;
+    }
+
+    // A writer is about: step back out so it can drain, and wait it out
+    long t0 = LOCK_PROFILE_WAIT_START();
+    srw_slot_leave(s);
+    if (l->policy == SRW_PHASE_FAIR) {
+        srw_read_lock_fair(l, s);
+    } else {
+        for (;;) {
+            srw_wait_zero(&l->writer, &l->writer_waiters, l->spin);
+            __atomic_fetch_add(&s->count, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&l->writer, __ATOMIC_SEQ_CST) == 0) {
+                break;
+            }
+            srw_slot_leave(s);
+        }
+    }
+    LOCK_PROFILE_ACQUIRED(&l->slots, t0, 1);
+}
+
+static inline void srwlock_read_unlock(srwlock_t *l) {
+    LOCK_PROFILE_RELEASED(&l->slots);
+    srw_slot_leave(srw_my_slot(l));
+}
+
+static inline void srwlock_write_lock(srwlock_t *l) {
+    long t0 = LOCK_PROFILE_WAIT_START();
+    int waited = 0;
+    // Count ourselves as pending first so new readers hold off (phase-fair:
+    // register for admission) while we wait for the mutex
+    __atomic_fetch_add(&l->writer, 1, __ATOMIC_SEQ_CST);
+    adaptive_mutex_lock(&l->wmutex);
+    if (l->policy == SRW_PHASE_FAIR) {
+        // The readers the last writer admitted go first
+        waited = srw_wait_zero(&l->handoff, &l->handoff_waiters, l->spin);
+    }
+    // Only slots handed out so far can hold readers; a thread that gets
+    // a new slot after this load sees the writer word and backs off
+    int used = __atomic_load_n(&srw_next_slot, __ATOMIC_SEQ_CST);
+    used = used < SRW_SLOTS ? used : SRW_SLOTS;
+    for (int i = 0; i < used; i++) {
+        waited |= srw_wait_zero(&l->slots[i].count, &l->slots[i].waiters, l->spin);
+    }
+    (void)waited;
+    LOCK_PROFILE_ACQUIRED(&l->writer, t0, waited);
+}
+
+static inline void srwlock_write_unlock(srwlock_t *l) {
+    LOCK_PROFILE_RELEASED(&l->writer);
+    int left = __atomic_sub_fetch(&l->writer, 1, __ATOMIC_SEQ_CST);
+    if (l->policy == SRW_PHASE_FAIR) {
+        // Admit everyone who registered during our phase and start the
+        // next one; only writers change the phase, under wmutex
+        unsigned long old = __atomic_load_n(&l->admit, __ATOMIC_SEQ_CST);
+        unsigned long next;
+        do {
+            next = ((old >> 32) + 1) << 32;
+        } while (!__atomic_compare_exchange_n(&l->admit, &old, next, 0,
+                                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+        int admitted = old & 0xffffffff;
+        if (admitted > 0) {
+            __atomic_fetch_add(&l->handoff, admitted, __ATOMIC_SEQ_CST);
+        }
+        __atomic_store_n(&l->phase, (int)(next >> 32), __ATOMIC_SEQ_CST);
+    }
+    // Let the next writer in before waking readers: on one CPU they tend
+    // to preempt us, and must not do so while we hold the mutex
+    pthread_mutex_unlock(&l->wmutex);
+    if (l->policy == SRW_PHASE_FAIR && __atomic_load_n(&l->phase_waiters, __ATOMIC_SEQ_CST) > 0) {
+        futex_wake(&l->phase, INT_MAX);
+    }
+    if (left == 0) {
+        srw_wake_zero(&l->writer, &l->writer_waiters);
+    }
+}
+
+#endif // __rwlock_h__
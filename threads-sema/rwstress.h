@@ -0,0 +1,275 @@
+#ifndef __rwstress_h__
+#define __rwstress_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common_threads.h"
+
+// Non-printing stress mode for the rwlock_t of reader-writer.c and
+// reader-writer-nostarve.c, run by rw-stress.c. Include it after rwlock_t
+// and the rwlock_* functions are defined; rw_stress_main() takes:
+//
+//   -b N   simulated work inside each critical section (N pause loops)
+//   -n N   simulated work between critical sections (default 0)
+//   -t     record an in-memory event trace and check it afterwards
+//
+// Every thread loops read (or write) critical sections until one of them
+// has done <loops>, so all threads run over the same period and the split
+// of ops between them shows who got the lock. The report gives reader and
+// writer throughput, the mean and max time a reader or writer waited to
+// get in (max writer wait is the starvation figure), and Jain's fairness
+// index over the per-thread op counts of each side (1 = even, 1/n = one
+// thread did everything).
+//
+// With -t each thread logs enter/exit events stamped from one shared
+// counter, so they have a single order consistent with the lock's own;
+// replaying that order must never show a writer inside with anyone else.
+// The shared counter serializes threads, so take timings without -t.
+
+typedef enum {
+    RW_READ_ENTER,
+    RW_READ_EXIT,
+    RW_WRITE_ENTER,
+    RW_WRITE_EXIT,
+} rw_event_kind_t;
+
+typedef struct {
+    long seq;
+    int thread;
+    rw_event_kind_t kind;
+} rw_event_t;
+
+typedef struct {
+    int id;
+    int writer;
+    long ops;
+    long wait_total;         // ns
+    long wait_max;
+    rw_event_t *trace;
+    long num_events;
+} __attribute__((aligned(64))) rw_stress_arg_t;
+
+typedef struct {
+    rwlock_t lock;
+    int loops;
+    int cs_work;
+    int think_work;
+    int stop;
+    long trace_seq;
+    int value;
+} rw_stress_t;
+
+static rw_stress_t rw_stress;
+
+static inline long rw_stress_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static inline void rw_stress_work(int n) {
+    for (int i = 0; i < n; i++)
+        cpu_relax();
+}
+
+static inline void rw_stress_log(rw_stress_arg_t *a, rw_event_kind_t kind) {
+    if (a->trace == NULL)
+        return;
+    rw_event_t *e = &a->trace[a->num_events++];
+    e->seq = __atomic_fetch_add(&rw_stress.trace_seq, 1, __ATOMIC_SEQ_CST);
+    e->thread = a->id;
+    e->kind = kind;
+}
+
+static void *rw_stress_thread(void *arg) {
+    rw_stress_arg_t *a = (rw_stress_arg_t *)arg;
+    rw_stress_t *s = &rw_stress;
+    while (!__atomic_load_n(&s->stop, __ATOMIC_RELAXED)) {
+        long start = rw_stress_now();
+        if (a->writer) {
+            rwlock_acquire_writelock(&s->lock);
+            rw_stress_log(a, RW_WRITE_ENTER);
+        } else {
+            rwlock_acquire_readlock(&s->lock);
+            rw_stress_log(a, RW_READ_ENTER);
+        }
+        long wait = rw_stress_now() - start;
+        a->wait_total += wait;
+        if (wait > a->wait_max)
+            a->wait_max = wait;
+
+        if (a->writer) {
+            __atomic_store_n(&s->value, s->value + 1, __ATOMIC_RELAXED);
+            rw_stress_work(s->cs_work);
+            rw_stress_log(a, RW_WRITE_EXIT);
+            rwlock_release_writelock(&s->lock);
+        } else {
+            (void)__atomic_load_n(&s->value, __ATOMIC_RELAXED);
+            rw_stress_work(s->cs_work);
+            rw_stress_log(a, RW_READ_EXIT);
+            rwlock_release_readlock(&s->lock);
+        }
+        if (++a->ops == s->loops)
+            __atomic_store_n(&s->stop, 1, __ATOMIC_RELAXED);
+        rw_stress_work(s->think_work);
+    }
+    return NULL;
+}
+
+static int rw_stress_cmp_seq(const void *x, const void *y) {
+    long a = ((const rw_event_t *)x)->seq, b = ((const rw_event_t *)y)->seq;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+// Replay the merged trace; returns the number of exclusion violations
+static long rw_stress_check(rw_stress_arg_t *args, int n, long *num_events) {
+    long total = 0;
+    for (int i = 0; i < n; i++)
+        total += args[i].num_events;
+    rw_event_t *all = malloc(total * sizeof(rw_event_t));
+    assert(all != NULL);
+    long k = 0;
+    for (int i = 0; i < n; i++) {
+        memcpy(&all[k], args[i].trace, args[i].num_events * sizeof(rw_event_t));
+        k += args[i].num_events;
+    }
+    qsort(all, total, sizeof(rw_event_t), rw_stress_cmp_seq);
+
+    long violations = 0;
+    int readers = 0, writers = 0;
+    for (long i = 0; i < total; i++) {
+        switch (all[i].kind) {
+        case RW_READ_ENTER:
+            if (writers > 0) {
+                if (violations++ < 5)
+                    printf("violation: reader %d entered at event %ld with a writer inside\n",
+                           all[i].thread, all[i].seq);
+            }
+            readers++;
+            break;
+        case RW_READ_EXIT:
+            readers--;
+            break;
+        case RW_WRITE_ENTER:
+            if (writers > 0 || readers > 0) {
+                if (violations++ < 5)
+                    printf("violation: writer %d entered at event %ld with %d readers, %d writers inside\n",
+                           all[i].thread, all[i].seq, readers, writers);
+            }
+            writers++;
+            break;
+        case RW_WRITE_EXIT:
+            writers--;
+            break;
+        }
+    }
+    free(all);
+    *num_events = total;
+    return violations;
+}
+
+// Jain's fairness index: (sum x)^2 / (n * sum x^2)
+static double rw_stress_jain(rw_stress_arg_t *args, int n) {
+    double sum = 0, sum_sq = 0;
+    for (int i = 0; i < n; i++) {
+        sum += args[i].ops;
+        sum_sq += (double)args[i].ops * args[i].ops;
+    }
+    return sum_sq > 0 ? sum * sum / (n * sum_sq) : 1.0;
+}
+
+static void rw_stress_side(const char *name, rw_stress_arg_t *args, int n, double elapsed) {
+    long ops = 0, wait_total = 0, wait_max = 0, min_ops = -1, max_ops = 0;
+    for (int i = 0; i < n; i++) {
+        ops += args[i].ops;
+        wait_total += args[i].wait_total;
+        if (args[i].wait_max > wait_max)
+            wait_max = args[i].wait_max;
+        if (min_ops < 0 || args[i].ops < min_ops)
+            min_ops = args[i].ops;
+        if (args[i].ops > max_ops)
+            max_ops = args[i].ops;
+    }
+    if (n == 0)
+        return;
+    printf("%s: %d threads, %ld ops, %.3g ops/sec, per thread min %ld / max %ld, "
+           "fairness %.3f, wait mean %ld ns, max %ld ns\n",
+           name, n, ops, ops / elapsed, min_ops, max_ops, rw_stress_jain(args, n),
+           ops ? wait_total / ops : 0, wait_max);
+}
+
+static int rw_stress_main(int argc, char *argv[]) {
+    int trace = 0, opt;
+    rw_stress.cs_work = 0;
+    rw_stress.think_work = 0;
+    while ((opt = getopt(argc, argv, "b:n:t")) != -1) {
+        switch (opt) {
+        case 'b': rw_stress.cs_work = atoi(optarg); break;
+        case 'n': rw_stress.think_work = atoi(optarg); break;
+        case 't': trace = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-b cs_work] [-n think_work] [-t] "
+                    "<num_readers> <num_writers> <loops>\n", argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 3) {
+        fprintf(stderr, "Usage: %s [-b cs_work] [-n think_work] [-t] "
+                "<num_readers> <num_writers> <loops>\n", argv[0]);
+        return 1;
+    }
+    int num_readers = atoi(argv[optind]);
+    int num_writers = atoi(argv[optind + 1]);
+    rw_stress.loops = atoi(argv[optind + 2]);
+    int n = num_readers + num_writers;
+    assert(num_readers >= 0 && num_writers >= 0 && n > 0 && rw_stress.loops > 0);
+
+    rwlock_init(&rw_stress.lock);
+    pthread_t p[n];
+    rw_stress_arg_t *args = aligned_alloc(64, n * sizeof(rw_stress_arg_t));
+    assert(args != NULL);
+    for (int i = 0; i < n; i++) {
+        memset(&args[i], 0, sizeof(args[i]));
+        args[i].id = i;
+        args[i].writer = (i >= num_readers);
+        if (trace) {
+            // Two events per op; no thread can do more than loops ops
+            args[i].trace = malloc(2L * rw_stress.loops * sizeof(rw_event_t));
+            assert(args[i].trace != NULL);
+        }
+    }
+
+    long start = rw_stress_now();
+    for (int i = 0; i < n; i++)
+        Pthread_create(&p[i], NULL, rw_stress_thread, &args[i]);
+    for (int i = 0; i < n; i++)
+        Pthread_join(p[i], NULL);
+    double elapsed = (rw_stress_now() - start) / 1e9;
+
+    long writes = 0;
+    for (int i = num_readers; i < n; i++)
+        writes += args[i].ops;
+    printf("cs_work %d, think_work %d, %.4f sec\n", rw_stress.cs_work, rw_stress.think_work,
+           elapsed);
+    rw_stress_side("readers", args, num_readers, elapsed);
+    rw_stress_side("writers", args + num_readers, num_writers, elapsed);
+    int ok = (rw_stress.value == writes);
+    if (!ok)
+        printf("BROKEN: value %d, expected %ld\n", rw_stress.value, writes);
+    if (trace) {
+        long events;
+        long violations = rw_stress_check(args, n, &events);
+        printf("trace: %ld events, %ld exclusion violations\n", events, violations);
+        ok = ok && violations == 0;
+        for (int i = 0; i < n; i++)
+            free(args[i].trace);
+    }
+    free(args);
+    return ok ? 0 : 1;
+}
+
+#endif // __rwstress_h__
@@ -0,0 +1,96 @@
+#ifndef __seqlock_h__
+#define __seqlock_h__
+
+#include <stddef.h>
+#include <sched.h>
+
+#include "common_threads.h"
+
+// Sequence lock for read-mostly values that readers only copy out.
+//
+// Writers serialize on a mutex and bump seq to odd before the update and
+// back to even after it. Readers never write shared memory: they note
+// seq, copy the payload, and retry if seq was odd or has changed. Reads
+// therefore scale with the number of readers, but a reader can spin
+// while a write is in progress, and the payload must be safe to copy
+// while it is being written (no pointers to follow).
+//
+// The payload is copied a word at a time with relaxed atomics, so a torn
+// copy is discarded by the retry rather than being a C11 data race.
+// Payload sizes must be a multiple of sizeof(long); SEQLOCK_READ and
+// SEQLOCK_WRITE take any such struct.
+
+#define SEQLOCK_SPIN 100     // reader spins on an odd seq before yielding
+
+typedef struct {
+    unsigned seq;            // odd while a write is in progress
+    pthread_mutex_t wlock;   // serializes writers
+} seqlock_t;
+
+static inline void seqlock_init(seqlock_t *s) {
+    s->seq = 0;
+    pthread_mutex_init(&s->wlock, NULL);
+}
+
+static inline void seqlock_destroy(seqlock_t *s) {
+    pthread_mutex_destroy(&s->wlock);
+}
+
+static inline unsigned seqlock_read_begin(seqlock_t *s) {
+    int spins = 0;
+    unsigned seq;
+    while ((seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE)) & 1) {
+        // The writer may have been preempted mid-update
+        if (++spins < SEQLOCK_SPIN) {
+            cpu_relax();
+        } else {
+            sched_yield();
+        }
+    }
+    return seq;
+}
+
+// True if the copy made since seqlock_read_begin() may be torn
+static inline int seqlock_read_retry(seqlock_t *s, unsigned start) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&s->seq, __ATOMIC_RELAXED) != start;
+}
+
+static inline void seqlock_write_lock(seqlock_t *s) {
+    adaptive_mutex_lock(&s->wlock);
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seqlock_write_unlock(seqlock_t *s) {
+    __atomic_store_n(&s->seq, s->seq + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&s->wlock);
+}
+
+static inline void seqlock_copy(void *dst, const void *src, size_t n) {
+    long *d = dst;
+    const long *p = src;
+    for (size_t i = 0; i < n / sizeof(long); i++) {
+        __atomic_store_n(&d[i], __atomic_load_n(&p[i], __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    }
+}
+
+// Copy *src (protected by s) into *dst, retrying until consistent
+#define SEQLOCK_READ(s, dst, src)                                   \
+    do {                                                            \
+        unsigned _seq;                                              \
+        do {                                                        \
+            _seq = seqlock_read_begin(s);                           \
+            seqlock_copy((dst), (src), sizeof(*(src)));             \
+        } while (seqlock_read_retry((s), _seq));                    \
+    } while (0)
+
+// Publish *src as the new value of *dst (protected by s)
+#define SEQLOCK_WRITE(s, dst, src)                                  \
+    do {                                                            \
+        seqlock_write_lock(s);                                      \
+        seqlock_copy((dst), (src), sizeof(*(dst)));                 \
+        seqlock_write_unlock(s);                                    \
+    } while (0)
+
+#endif // __seqlock_h__
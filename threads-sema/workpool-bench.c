@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "common_threads.h"
+#include "workpool.h"
+
+// Task overhead benchmark: parallel fib(n), where every call with
+// n >= cutoff forks fib(n-1) as a task and computes fib(n-2) itself.
+//
+//   serial            plain recursion, the baseline
+//   pool              workpool.h with 1, 2, 4, ... up to <max_threads>
+//                     workers
+//   thread per task   one pthread per task, joined with a semaphore like
+//                     fork-join.c (on a smaller n, since every task is a
+//                     live thread)
+//
+// The per-task figure is (elapsed - serial) / tasks: what forking and
+// joining a task costs on top of the work itself.
+
+#define THREAD_MAX_N 16
+
+typedef struct {
+    int n;
+    int cutoff;
+    long result;
+} fib_arg_t;
+
+long fib_serial(int n) {
+    return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2);
+}
+
+// Number of tasks fib(n) forks
+long fib_tasks(int n, int cutoff) {
+    if (n < cutoff || n < 2)
+        return 0;
+    return 1 + fib_tasks(n - 1, cutoff) + fib_tasks(n - 2, cutoff);
+}
+
+void fib_pool(void *arg) {
+    fib_arg_t *a = (fib_arg_t *)arg;
+    if (a->n < a->cutoff || a->n < 2) {
+        a->result = fib_serial(a->n);
+        return;
+    }
+    fib_arg_t left = { a->n - 1, a->cutoff, 0 };
+    fib_arg_t right = { a->n - 2, a->cutoff, 0 };
+    task_t t;
+    pool_spawn(&t, fib_pool, &left);
+    fib_pool(&right);
+    pool_sync(&t);
+    a->result = left.result + right.result;
+}
+
+// === Thread per task ===
+
+typedef struct {
+    fib_arg_t fib;
+    sem_t done;
+} thread_arg_t;
+
+pthread_attr_t detached;
+
+void *fib_thread(void *arg) {
+    thread_arg_t *a = (thread_arg_t *)arg;
+    if (a->fib.n < a->fib.cutoff || a->fib.n < 2) {
+        a->fib.result = fib_serial(a->fib.n);
+    } else {
+        thread_arg_t left = { .fib = { a->fib.n - 1, a->fib.cutoff, 0 } };
+        thread_arg_t right = { .fib = { a->fib.n - 2, a->fib.cutoff, 0 } };
+        pthread_t p;
+        Sem_init(&left.done, 0);
+        Sem_init(&right.done, 0);  // posted by the inline call, never waited on
+        Pthread_create(&p, &detached, fib_thread, &left);
+        fib_thread(&right);
+        Sem_wait(&left.done);  // Wait for child to signal completion
+        sem_destroy(&left.done);
+        sem_destroy(&right.done);
+        a->fib.result = left.fib.result + right.fib.result;
+    }
+    Sem_post(&a->done);
+    return NULL;
+}
+
+static inline long get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+double time_serial(int n, long *result) {
+    long start = get_time_ns();
+    *result = fib_serial(n);
+    return (get_time_ns() - start) / 1e9;
+}
+
+void report(const char *name, int n, long tasks, double elapsed, double serial, long result) {
+    printf("%-18s fib(%d): %.6f sec, %ld tasks, %.1f ns per task", name, n, elapsed, tasks,
+           tasks ? (elapsed - serial) * 1e9 / tasks : 0.0);
+    if (result != fib_serial(n))
+        printf(", WRONG (%ld)", result);
+}
+
+void run_pool(int num_threads, int n, int cutoff, double serial) {
+    work_pool_t pool;
+    pool_init(&pool, num_threads);
+    fib_arg_t a = { n, cutoff, 0 };
+    long start = get_time_ns();
+    pool_run(&pool, fib_pool, &a);
+    double elapsed = (get_time_ns() - start) / 1e9;
+
+    long stolen = 0, inlined = 0;
+    for (int i = 0; i < num_threads; i++) {
+        stolen += pool.workers[i].stolen;
+        inlined += pool.workers[i].inlined;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "pool, %d threads", num_threads);
+    report(name, n, fib_tasks(n, cutoff), elapsed, serial, a.result);
+    printf(", %ld stolen", stolen);
+    if (inlined > 0)
+        printf(", %ld inlined", inlined);
+    printf("\n");
+    pool_destroy(&pool);
+}
+
+void run_thread(int n, int cutoff, double serial) {
+    thread_arg_t a = { .fib = { n, cutoff, 0 } };
+    Sem_init(&a.done, 0);
+    long start = get_time_ns();
+    fib_thread(&a);
+    double elapsed = (get_time_ns() - start) / 1e9;
+    sem_destroy(&a.done);
+    report("thread per task", n, fib_tasks(n, cutoff), elapsed, serial, a.fib.result);
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "Usage: %s <max_threads> <n> [cutoff]\n", argv[0]);
+        return 1;
+    }
+    int num_threads = atoi(argv[1]);
+    int n = atoi(argv[2]);
+    int cutoff = (argc == 4) ? atoi(argv[3]) : 2;
+    assert(num_threads > 0 && n >= 0 && n < 50);
+
+    long result;
+    double serial = time_serial(n, &result);
+    printf("fib(%d) = %ld, serial %.6f sec, cutoff %d\n", n, result, serial, cutoff);
+
+    for (int t = 1; t < num_threads; t *= 2)
+        run_pool(t, n, cutoff, serial);
+    run_pool(num_threads, n, cutoff, serial);
+
+    int tn = n < THREAD_MAX_N ? n : THREAD_MAX_N;
+    assert(pthread_attr_init(&detached) == 0);
+    assert(pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED) == 0);
+    run_thread(tn, cutoff, time_serial(tn, &result));
+    return 0;
+}
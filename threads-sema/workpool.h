@@ -0,0 +1,291 @@
+#ifndef __workpool_h__
+#define __workpool_h__
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "common_threads.h"
+
+// Work-stealing thread pool for fork/join parallelism.
+//
+// Each worker owns a Chase-Lev deque: it pushes and pops tasks at the
+// bottom without any atomic read-modify-write (except to race a thief for
+// the last task), and idle workers steal the oldest task from the top of
+// a random victim's deque with one CAS. Forking a task is a store into
+// the owner's own deque; compare fork-join.c, which pays a pthread_create
+// for every child.
+//
+// The thread that calls pool_run() acts as worker 0 for the duration of
+// the call, so only one pool_run() may be in progress at a time. Inside a
+// task:
+//
+//     task_t child;
+//     pool_spawn(&child, fn, arg);   // may run in parallel
+//     ...                            // do the other half ourselves
+//     pool_sync(&child);             // wait for it
+//
+// pool_sync() never blocks: while the child is unfinished the joiner runs
+// tasks from its own deque or steals from others. Spawns must be synced
+// in reverse order (strict fork/join), and the task_t must outlive the
+// sync, which is why it usually lives on the spawner's stack.
+//
+// Workers with nothing to do spin briefly on multi-CPU machines and then
+// sleep on a futex; pool_spawn() wakes one only if some are asleep. The
+// deques are fixed-size: a spawn that finds its deque full runs the task
+// inline instead.
+
+#define WS_DEQUE_SIZE 1024   // power of two
+#define WS_SPIN 1000         // steal attempts before sleeping, on multi-CPU machines
+
+typedef void (*task_fn_t)(void *arg);
+
+typedef struct {
+    task_fn_t fn;
+    void *arg;
+    int done;
+} task_t;
+
+typedef struct {
+    long top __attribute__((aligned(64)));     // thieves take from here
+    long bottom __attribute__((aligned(64)));  // owner pushes and pops here
+    task_t *tasks[WS_DEQUE_SIZE];
+} ws_deque_t;
+
+struct work_pool;
+
+typedef struct {
+    ws_deque_t deque;
+    struct work_pool *pool;
+    pthread_t thread;
+    int id;
+    unsigned seed;
+    long executed;           // tasks this worker ran
+    long stolen;             // of those, taken from another worker
+    long inlined;            // spawns run inline because the deque was full
+} __attribute__((aligned(64))) ws_worker_t;
+
+typedef struct work_pool {
+    ws_worker_t *workers;
+    int num_workers;
+    int spin;
+    int idle_seq __attribute__((aligned(64)));  // futex word, bumped by spawns
+    int sleepers;
+    int stop;
+} work_pool_t;
+
+static __thread ws_worker_t *ws_self;
+
+// === Deque ===
+
+// Owner only. Returns 0 if full.
+static inline int ws_push(ws_deque_t *d, task_t *t) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    if (b - top >= WS_DEQUE_SIZE) {
+        return 0;
+    }
+    __atomic_store_n(&d->tasks[b & (WS_DEQUE_SIZE - 1)], t, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Owner only. Newest task, or NULL.
+static inline task_t *ws_take(ws_deque_t *d) {
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    task_t *t = NULL;
+    if (top <= b) {
+        t = __atomic_load_n(&d->tasks[b & (WS_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+        if (top == b) {
+            // Last one: race the thieves for it
+            if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+                                             __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                t = NULL;
+            }
+            __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return t;
+}
+
+// Any thread. Oldest task, or NULL if empty or we lost a race.
+static inline task_t *ws_steal(ws_deque_t *d) {
+    long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (top >= b) {
+        return NULL;
+    }
+    task_t *t = __atomic_load_n(&d->tasks[top & (WS_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return t;
+}
+
+static inline int ws_empty(ws_deque_t *d) {
+    return __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE) <=
+           __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+}
+
+// === Workers ===
+
+static inline void ws_execute(ws_worker_t *w, task_t *t) {
+    t->fn(t->arg);
+    w->executed++;
+    __atomic_store_n(&t->done, 1, __ATOMIC_RELEASE);
+}
+
+// One pass over the other workers, starting at a random one
+static inline task_t *ws_steal_any(ws_worker_t *w) {
+    work_pool_t *pool = w->pool;
+    int n = pool->num_workers;
+    int start = rand_r(&w->seed) % n;
+    for (int i = 0; i < n; i++) {
+        ws_worker_t *victim = &pool->workers[(start + i) % n];
+        if (victim == w) {
+            continue;
+        }
+        task_t *t = ws_steal(&victim->deque);
+        if (t != NULL) {
+            w->stolen++;
+            return t;
+        }
+    }
+    return NULL;
+}
+
+static inline int ws_any_work(work_pool_t *pool) {
+    for (int i = 0; i < pool->num_workers; i++) {
+        if (!ws_empty(&pool->workers[i].deque)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static inline void ws_sleep(work_pool_t *pool) {
+    int seq = __atomic_load_n(&pool->idle_seq, __ATOMIC_ACQUIRE);
+    __atomic_fetch_add(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!ws_any_work(pool) && !__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE)) {
+        futex_wait(&pool->idle_seq, seq);
+    }
+    __atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_RELAXED);
+}
+
+static inline void ws_wake(work_pool_t *pool, int n) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_RELAXED) > 0) {
+        __atomic_fetch_add(&pool->idle_seq, 1, __ATOMIC_RELEASE);
+        futex_wake(&pool->idle_seq, n);
+    }
+}
+
+static void *ws_worker_main(void *arg) {
+    ws_worker_t *w = (ws_worker_t *)arg;
+    work_pool_t *pool = w->pool;
+    ws_self = w;
+    int idle = 0;
+    while (!__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE)) {
+        task_t *t = ws_take(&w->deque);
+        if (t == NULL) {
+            t = ws_steal_any(w);
+        }
+        if (t != NULL) {
+            ws_execute(w, t);
+            idle = 0;
+        } else if (++idle < pool->spin) {
+            cpu_relax();
+        } else {
+            ws_sleep(pool);
+            idle = 0;
+        }
+    }
+    return NULL;
+}
+
+// === API ===
+
+static inline void pool_init(work_pool_t *pool, int num_workers) {
+    assert(num_workers > 0);
+    memset(pool, 0, sizeof(*pool));
+    pool->workers = aligned_alloc(64, num_workers * sizeof(ws_worker_t));
+    assert(pool->workers != NULL);
+    memset(pool->workers, 0, num_workers * sizeof(ws_worker_t));
+    pool->num_workers = num_workers;
+    pool->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? WS_SPIN : 0;
+    for (int i = 0; i < num_workers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        pool->workers[i].seed = i + 1;
+    }
+    // Worker 0 is whoever calls pool_run()
+    for (int i = 1; i < num_workers; i++) {
+        Pthread_create(&pool->workers[i].thread, NULL, ws_worker_main, &pool->workers[i]);
+    }
+}
+
+static inline void pool_destroy(work_pool_t *pool) {
+    __atomic_store_n(&pool->stop, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&pool->idle_seq, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&pool->idle_seq, INT_MAX);
+    for (int i = 1; i < pool->num_workers; i++) {
+        Pthread_join(pool->workers[i].thread, NULL);
+    }
+    free(pool->workers);
+    pool->workers = NULL;
+}
+
+// Make t available to other workers; the caller must pool_sync() it
+static inline void pool_spawn(task_t *t, task_fn_t fn, void *arg) {
+    ws_worker_t *w = ws_self;
+    assert(w != NULL);       // only from inside pool_run()
+    t->fn = fn;
+    t->arg = arg;
+    t->done = 0;
+    if (!ws_push(&w->deque, t)) {
+        w->inlined++;
+        ws_execute(w, t);
+        return;
+    }
+    ws_wake(w->pool, 1);
+}
+
+// Wait for a spawned task, running other tasks meanwhile
+static inline void pool_sync(task_t *t) {
+    ws_worker_t *w = ws_self;
+    while (!__atomic_load_n(&t->done, __ATOMIC_ACQUIRE)) {
+        // Usually t itself is still on top of our deque
+        task_t *next = ws_take(&w->deque);
+        if (next == NULL) {
+            next = ws_steal_any(w);
+        }
+        if (next != NULL) {
+            ws_execute(w, next);
+        } else if (w->pool->spin == 0) {
+            // A thief is running t and needs this CPU to finish it
+            sched_yield();
+        } else {
+            cpu_relax();
+        }
+    }
+}
+
+// Run fn(arg) on the pool from outside it and wait for everything it spawns
+static inline void pool_run(work_pool_t *pool, task_fn_t fn, void *arg) {
+    ws_worker_t *w = &pool->workers[0];
+    ws_self = w;
+    task_t root = { fn, arg, 0 };
+    ws_execute(w, &root);
+    ws_self = NULL;
+}
+
+#endif // __workpool_h__